@@ -0,0 +1,74 @@
+/*
+ * SensorFilter.h
+ *
+ * ESP8266 / ESP32 Environmental Sensor
+ *
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef __ESP_SENSOR_FILTER__
+#define __ESP_SENSOR_FILTER__
+
+#include <Arduino.h>
+
+// ring buffer of recent samples per channel
+#define SENSOR_FILTER_SIZE 5
+
+// samples dropped on both ends before averaging. (SIZE - 1) / 2 gives the median.
+#define SENSOR_FILTER_TRIM 1
+
+// budget for a single update(), whatever runs out first
+#define SENSOR_FILTER_MAX_TRIES 3
+#define SENSOR_FILTER_MAX_TIME 10
+
+// consecutive failed updates before the channel goes into error state
+#define SENSOR_FILTER_MAX_FAILS 3
+
+typedef float (*sensor_read_t)(void);
+
+/*
+ * Trimmed mean over the last SENSOR_FILTER_SIZE plausible samples.
+ * Single outliers are dropped by the sorting, implausible readings
+ * (NaN or outside of the configured limits) are never stored.
+ * After SENSOR_FILTER_MAX_FAILS failed updates in a row the old samples
+ * are discarded and the filter reports invalid until new data arrives.
+ */
+class SensorFilter {
+public:
+    SensorFilter(void);
+
+    void setLimits(float min, float max) { limit_min = min; limit_max = max; }
+
+    // read at most MAX_TRIES times within MAX_TIME ms. true if a sample was accepted.
+    bool update(sensor_read_t read);
+
+    // feed a sample acquired elsewhere. true if it was accepted.
+    bool add(float sample);
+
+    // report an acquisition that did not produce a sample
+    void fail(void);
+
+    void reset(void);
+
+    float value(void) { return filtered; }
+    bool valid(void) { return (count > 0); }
+    bool error(void) { return (fails >= SENSOR_FILTER_MAX_FAILS); }
+    unsigned long errors(void) { return error_count; }
+
+private:
+    bool plausible(float sample);
+    void calculate(void);
+
+    float buffer[SENSOR_FILTER_SIZE];
+    uint8_t head, count, fails;
+    float filtered;
+    float limit_min, limit_max;
+    unsigned long error_count;
+};
+
+#endif // __ESP_SENSOR_FILTER__
@@ -0,0 +1,50 @@
+/*
+ * SimpleGzip.h
+ *
+ * ESP8266 / ESP32 Environmental Sensor
+ *
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef __ESP_SIMPLE_GZIP__
+#define __ESP_SIMPLE_GZIP__
+
+#include <stdint.h>
+
+// matches are only searched this far back, max. 32768
+#define SIMPLE_GZIP_WINDOW 4096
+
+// entries in the match table, two bytes each, power of two
+#define SIMPLE_GZIP_HASH_SIZE 512
+
+/*
+ * Minimal gzip compressor: greedy LZ77 with one candidate per hash
+ * and the fixed Huffman codes of deflate, so no trees need to be built
+ * or stored. Good enough for the repetitive Influx line protocol, and
+ * needs no memory besides the hash table and the output buffer.
+ */
+class SimpleGzip {
+  public:
+    // returns the compressed size, or -1 if it does not fit into out
+    int compress(const uint8_t *in, int len, uint8_t *out, int size);
+
+  private:
+    void putBits(uint32_t bits, int count);
+    void putCode(uint32_t code, int count);
+    void putLiteral(int value);
+    void putMatch(int length, int distance);
+
+    uint16_t hash_table[SIMPLE_GZIP_HASH_SIZE];
+
+    uint8_t *out_buf;
+    int out_size, out_pos;
+    uint32_t bit_buf;
+    int bit_count;
+};
+
+#endif // __ESP_SIMPLE_GZIP__
@@ -14,50 +14,196 @@
 #ifndef __ESP_SIMPLE_INFLUX__
 #define __ESP_SIMPLE_INFLUX__
 
-#define SIMPLE_INFLUX_MAX_ELEMENTS 3
+#if defined(ARDUINO_ARCH_ESP8266)
+#include <ESP8266HTTPClient.h>
+#include <WiFiClient.h>
+#elif defined(ARDUINO_ARCH_ESP32)
+#include <HTTPClient.h>
+#include <WiFiClient.h>
+#endif
 
-class InfluxData {
+// gzip request bodies with -DENABLE_INFLUX_GZIP, ESP8266 and ESP32 only
+#if defined(ENABLE_INFLUX_GZIP) && (defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32))
+#include "SimpleGzip.h"
+#define SIMPLE_INFLUX_GZIP
+#endif
+
+// default capacity of one point in line protocol, without timestamp
+#if defined(ARDUINO_ARCH_AVR)
+#define SIMPLE_INFLUX_MAX_LINE 160
+#else
+#define SIMPLE_INFLUX_MAX_LINE 256
+#endif
+
+// upper limit for the line protocol body of one request
+#if defined(ARDUINO_ARCH_AVR)
+#define SIMPLE_INFLUX_MAX_BATCH 512
+#else
+#define SIMPLE_INFLUX_MAX_BATCH 2048
+#endif
+
+// close a kept-alive connection after this many ms without requests
+#define SIMPLE_INFLUX_IDLE_TIMEOUT (60 * 1000)
+
+/*
+ * store-and-forward queue for points that could not be sent yet, in bytes,
+ * see config.h. By default, and with 2k SRAM on AVR, it only holds two
+ * points, enough to stream the body from. prepare() sends them when the
+ * next one does not fit anymore.
+ */
+#ifndef SIMPLE_INFLUX_QUEUE_SIZE
+#define SIMPLE_INFLUX_QUEUE_SIZE (2 * (SIMPLE_INFLUX_MAX_LINE + 1))
+#endif
+
+#if SIMPLE_INFLUX_QUEUE_SIZE < (SIMPLE_INFLUX_MAX_LINE + 1)
+#error "SIMPLE_INFLUX_QUEUE_SIZE has to hold at least one point"
+#endif
+
+// max. number of requests per write() when draining the queue
+#define SIMPLE_INFLUX_MAX_DRAIN 4
+
+// anything before this is a clock that has not been set yet (2020-09-13)
+#define SIMPLE_INFLUX_VALID_TIME 1600000000
+
+enum influx_precision {
+    INFLUX_PRECISION_S = 0,
+    INFLUX_PRECISION_MS,
+};
+
+enum influx_send_result {
+    INFLUX_SENT = 0,
+    INFLUX_RETRY, // server not reachable, keep the data
+    INFLUX_REJECTED, // server refused the data (4xx), sending it again won't help
+};
+
+/*
+ * Builds the line protocol of a point in place while tags and values are
+ * added, so it is ready to be copied into a request with its exact length.
+ * Strings are copied and escaped, temporaries may be passed in.
+ * When the buffer is too small the point is marked as overflowed instead
+ * of losing data silently, and Influxdb will not send it.
+ */
+class InfluxLine {
   public:
-    InfluxData(const char *name) : data_name(name), tag_count(0), value_count(0) { }
-    void addTag(const char *name, const char *value);
-    void addTag(const char *name, String &value) { addTag(name, value.c_str()); }
-    void addValue(const char *name, double value);
+    InfluxLine(char *buf, int size)
+        : buffer(buf), buffer_size(size), line_length(0),
+        name_length(0), tags_end(0), value_count(0), overflow(false), time_ms(0) { }
 
-    int tagCount() { return tag_count; }
-    const char *tagName(int tag) { return tag_name[tag < tag_count ? tag : 0]; }
-    const char *tagValue(int tag) { return tag_value[tag < tag_count ? tag : 0]; }
+    boolean addTag(const char *name, const char *value);
+    boolean addTag(const char *name, const String &value) { return addTag(name, value.c_str()); }
+    boolean addValue(const char *name, double value);
 
-    int valueCount() { return value_count; }
-    const char *valueName(int val) { return value_name[val < value_count ? val : 0]; }
-    double valueValue(int val) { return value_value[val < value_count ? val : 0]; }
+    void setName(const char *n);
+    void clear() { line_length = tags_end = name_length; value_count = 0; overflow = false; time_ms = 0; }
 
-    const char *dataName() { return data_name; }
-    void setName(const char *n) { data_name = n; }
+    // ms since the epoch, 0 to use the time of prepare()
+    void setTime(uint64_t ms) { time_ms = ms; }
+    uint64_t time() { return time_ms; }
 
-    void clear() { tag_count = 0; value_count = 0;}
+    const char *line() { return buffer; }
+    int length() { return line_length; }
+    int valueCount() { return value_count; }
+    boolean overflowed() { return overflow; }
 
   private:
-    const char *data_name;
+    InfluxLine(const InfluxLine &) = delete;
+    InfluxLine &operator=(const InfluxLine &) = delete;
 
-    const char *tag_name[SIMPLE_INFLUX_MAX_ELEMENTS];
-    const char *tag_value[SIMPLE_INFLUX_MAX_ELEMENTS];
-    int tag_count;
+    boolean makeRoom(int pos, int len);
+    int put(int pos, const char *s, const char *special);
 
-    const char *value_name[SIMPLE_INFLUX_MAX_ELEMENTS];
-    double value_value[SIMPLE_INFLUX_MAX_ELEMENTS];
-    int value_count;
+    char *buffer;
+    int buffer_size, line_length;
+    int name_length, tags_end, value_count;
+    boolean overflow;
+    uint64_t time_ms;
 };
 
+template<int N>
+class InfluxPoint : public InfluxLine {
+  public:
+    InfluxPoint(const char *name) : InfluxLine(storage, N) { setName(name); }
+
+  private:
+    char storage[N];
+};
+
+typedef InfluxPoint<SIMPLE_INFLUX_MAX_LINE> InfluxData;
+
+/*
+ * Points are collected with prepare() and sent as a single multi-line
+ * request by write(), like the batch API of the InfluxDB library.
+ * write(data) still sends a single point immediately.
+ * On the ESP8266 and ESP32 the HTTP connection is kept alive between requests.
+ *
+ * Prepared points go into a ring buffer and only leave it once the
+ * server accepted them, so nothing is lost while it is unreachable.
+ * When the buffer is full the oldest points are dropped. Points carry
+ * the time given with setTime(), or the time they were prepared, if the
+ * clock has been set via NTP.
+ */
 class Influxdb {
   public:
-    Influxdb(const char *host, int port) : db_host(host), db_port(port) { }
+    Influxdb(const char *host, int port)
+        : db_host(host), db_port(port),
+        precision(INFLUX_PRECISION_S), queue_head(0), queue_tail(0), queue_used(0), queue_lines(0), dropped_lines(0), rejected_lines(0),
+        last_request(0), new_connections(0), reused_connections(0),
+        body_bytes(0), sent_bytes(0), last_response(0), verbose(true) { }
     void setDb(const char *db) { db_name = db; }
-    boolean write(InfluxData &data);
+    void setPrecision(enum influx_precision p) { precision = p; } // before the first prepare()
+    void setVerbose(boolean v) { verbose = v; } // false when used outside of loop()
+    void prepare(InfluxLine &data);
+    void prepare(const char *line, int len, uint64_t time_ms = 0); // one point, without newline
+    boolean write(void);
+    boolean write(InfluxLine &data);
+
+    unsigned long newConnections() { return new_connections; }
+    unsigned long reusedConnections() { return reused_connections; }
+    int queuedPoints() { return queue_lines; }
+    unsigned long droppedPoints() { return dropped_lines; }
+    unsigned long rejectedPoints() { return rejected_lines; }
+    unsigned long bodyBytes() { return body_bytes; }
+    unsigned long sentBytes() { return sent_bytes; }
+    int lastResponse() { return last_response; } // HTTP status, < 0 when not connected
 
   private:
+      void push(const char *data, int len);
+      void copyOut(char *dst, int len);
+      void dropOldest(void);
+      int peek(int max);
+      int discard(int len);
+      enum influx_send_result send(int len);
+
       const char *db_host;
       int db_port;
       const char *db_name;
+      enum influx_precision precision;
+
+      char queue[SIMPLE_INFLUX_QUEUE_SIZE];
+      int queue_head, queue_tail, queue_used, queue_lines;
+      unsigned long dropped_lines;
+      unsigned long rejected_lines;
+
+#if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
+      WiFiClient client;
+      HTTPClient http;
+
+      // HTTPClient needs the body in one piece
+      char batch[SIMPLE_INFLUX_MAX_BATCH];
+#endif
+
+#ifdef SIMPLE_INFLUX_GZIP
+      SimpleGzip gzip;
+      uint8_t gzip_batch[SIMPLE_INFLUX_MAX_BATCH];
+#endif
+
+      unsigned long last_request;
+      unsigned long new_connections;
+      unsigned long reused_connections;
+      unsigned long body_bytes; // line protocol
+      unsigned long sent_bytes; // after compression
+      int last_response;
+      boolean verbose;
 };
 
 #endif // __ESP_SIMPLE_INFLUX__
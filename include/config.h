@@ -36,12 +36,35 @@
 #define MQTT_PORT 1883
 #define MQTT_USER "USERNAME" // undef to disable auth
 #define MQTT_PASS "PASSWORD" // undef to disable auth
+//#define MQTT_PERSISTENT_SESSION // keep subscriptions and missed messages over reconnects
+
+// sensor values are published when they move more than this
+#define MQTT_DEADBAND_TEMPERATURE 0.2 // in degC
+#define MQTT_DEADBAND_HUMIDITY 1.0 // in %RH
+#define MQTT_DEADBAND_PRESSURE 50.0 // in Pa
+#define MQTT_DEADBAND_ECO2 50.0 // in ppm
+#define MQTT_DEADBAND_TVOC 10.0 // in ppb
 
 // InfluxDB settings
 #define INFLUXDB_HOST "INFLUX_IP_HERE"
 #define INFLUXDB_PORT 8086
 #define INFLUXDB_DATABASE "roomsensorsdiy"
 //#define INFLUX_MAX_ERRORS_RESET 10
+#define INFLUX_TASK_QUEUE_LEN 16 // points waiting for the writer task (ESP32)
+#define INFLUX_TASK_LINE_SIZE 256 // max. length of one point in line protocol
+
+// bytes kept for points SimpleInflux could not send yet, can be set per env in platformio.ini
+#ifndef SIMPLE_INFLUX_QUEUE_SIZE
+#if defined(ARDUINO_ARCH_ESP8266)
+#define SIMPLE_INFLUX_QUEUE_SIZE (3 * 1024)
+#elif defined(ARDUINO_ARCH_ESP32)
+#define SIMPLE_INFLUX_QUEUE_SIZE (16 * 1024)
+#endif
+#endif // ! SIMPLE_INFLUX_QUEUE_SIZE
+
+// Touch UI settings
+#define UI_SPRITE_DMA // compose buttons off-screen and push them with DMA, undef to draw directly
+#define UI_BUTTON_CACHE_SIZE (48 * 1024) // bytes for pre-rendered buttons, needs UI_SPRITE_DMA
 
 // LoRa SML Bridge "Crypto"
 // needs to be sizeof(struct lora_sml_msg) bytes long
@@ -50,14 +73,23 @@
 
 // all given in milliseconds
 #define SERVER_HANDLE_INTERVAL 10
+#define MQTT_HANDLE_INTERVAL 10
+#define UI_HANDLE_INTERVAL 10
+#define UI_FRAME_INTERVAL 100 // min. time between redraws caused by MQTT
+#define LORA_HANDLE_INTERVAL 10
+#define SML_HANDLE_INTERVAL 10
 #define SENSOR_HANDLE_INTERVAL (5 * 1000)
 #define DB_WRITE_INTERVAL (30 * 1000)
-#define MQTT_WRITE_INTERVAL (30 * 1000)
+#define MQTT_WRITE_INTERVAL (30 * 1000) // heartbeat check, new samples trigger a write
+#define MQTT_MAX_SILENCE (5 * 60 * 1000) // publish unchanged values again
 #define LED_BLINK_INTERVAL (2 * 1000)
 #define LED_INIT_BLINK_INTERVAL 500
 #define LED_CONNECT_BLINK_INTERVAL 250
 #define LED_ERROR_BLINK_INTERVAL 100
-#define MQTT_RECONNECT_INTERVAL (5 * 1000)
+#define MQTT_RECONNECT_INTERVAL (5 * 1000) // first backoff step, doubled on each failure
+#define MQTT_RECONNECT_MAX (5 * 60 * 1000) // upper limit of the backoff
+#define MQTT_CONNECT_TIMEOUT 1000 // for TCP connect and CONNACK each
+#define SCHED_MAX_IDLE 100
 
 #define NTP_SERVER "pool.ntp.org"
 
@@ -98,6 +130,14 @@
 #define FEATURE_MOISTURE
 #endif
 
+#if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
+#define FEATURE_PROFILER
+#endif
+
+#if defined(ARDUINO_ARCH_ESP32)
+#define FEATURE_INFLUX_TASK
+#endif
+
 #if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
 #define BUILTIN_LED_PIN 1
 #elif defined(ARDUINO_ARCH_AVR)
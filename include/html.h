@@ -19,6 +19,10 @@
 void handlePage(int mode = -1, int id = 0);
 void handleReset();
 
+#ifdef FEATURE_PROFILER
+void handleProfile();
+#endif // FEATURE_PROFILER
+
 #else
 
 void handlePage(WiFiClient &client, int mode = -1, int id = 0);
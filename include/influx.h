@@ -17,7 +17,9 @@
 void initInflux();
 void runInflux();
 void writeDatabase();
+void requestDatabaseWrite();
+String influxStatus();
 
-void writeSensorDatum(String measurement, String sensor, String placement, String key, double value);
+void writeSensorDatum(const char *measurement, const char *sensor, const char *placement, const char *key, double value);
 
 #endif // __INFLUX_H__
@@ -0,0 +1,38 @@
+/*
+ * led.h
+ *
+ * ESP8266 / ESP32 Environmental Sensor
+ *
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef __ESP_ENV_LED__
+#define __ESP_ENV_LED__
+
+enum led_pattern {
+    // endless, replace each other
+    LED_PATTERN_OFF = 0,
+    LED_PATTERN_HEARTBEAT,
+    LED_PATTERN_CONNECTING,
+
+    // played once on top of the endless pattern
+    LED_PATTERN_INIT,
+    LED_PATTERN_ERROR,
+
+    LED_PATTERN_COUNT
+};
+
+void led_init(void);
+
+// switch to a new pattern. safe to call from other tasks and ISRs.
+void led_set(enum led_pattern pattern);
+
+// advance the current pattern. runs as scheduler job, call it from busy loops.
+void led_run(void);
+
+#endif // __ESP_ENV_LED__
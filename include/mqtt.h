@@ -16,6 +16,8 @@
 
 void initMQTT();
 void runMQTT();
+String mqttStatus();
+void requestMQTTWrite();
 
 #ifdef FEATURE_UI
 void writeMQTT_UI(void);
@@ -0,0 +1,44 @@
+/*
+ * profiler.h
+ *
+ * ESP8266 / ESP32 Environmental Sensor
+ *
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef __ESP_ENV_PROFILER__
+#define __ESP_ENV_PROFILER__
+
+#ifdef FEATURE_PROFILER
+
+#include "scheduler.h"
+
+// one slot per scheduler job, plus the whole loop pass
+#define PROF_MAX_SLOTS (SCHED_MAX_JOBS + 1)
+
+// bucket n counts durations in [2^n, 2^(n+1)) us, last one is open ended
+#define PROF_BUCKETS 24
+
+struct prof_stats {
+    const char *name;
+    unsigned long count;
+    unsigned long min, max; // in us
+    uint64_t sum; // in us
+    unsigned long hist[PROF_BUCKETS];
+};
+
+int prof_add(const char *name);
+void prof_record(int slot, unsigned long us);
+void prof_reset(void);
+
+int prof_count(void);
+const struct prof_stats *prof_get(int slot);
+
+#endif // FEATURE_PROFILER
+
+#endif // __ESP_ENV_PROFILER__
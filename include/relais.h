@@ -18,6 +18,6 @@ void relais_init(void);
 int relais_count(void);
 void relais_set(int relais, int state);
 int relais_get(int relais);
-String relais_name(int relais);
+const char *relais_name(int relais);
 
 #endif // __ESP_RELAIS_ACTOR__
@@ -0,0 +1,52 @@
+/*
+ * scheduler.h
+ *
+ * ESP8266 / ESP32 Environmental Sensor
+ *
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef __ESP_ENV_SCHEDULER__
+#define __ESP_ENV_SCHEDULER__
+
+#define SCHED_MAX_JOBS 12
+
+typedef void (*sched_func_t)(void);
+
+struct sched_job {
+    const char *name;
+    sched_func_t func;
+    unsigned long interval; // in ms, 0 for purely event triggered jobs
+    unsigned long deadline; // millis() timestamp of next periodic run
+    volatile bool triggered;
+    bool armed; // one-shot deadline pending, see sched_trigger_in()
+
+    unsigned long runs;
+    unsigned long max_late; // worst deadline miss in ms
+    int prof; // profiler slot
+};
+
+/*
+ * Register a job. Periodic jobs (interval > 0) first run one interval
+ * after registration. Returns job id or -1 when the table is full.
+ */
+int sched_add(const char *name, sched_func_t func, unsigned long interval);
+
+// run job on next pass, regardless of its deadline. safe to call from ISRs.
+void sched_trigger(int job);
+
+// move the next run of a job to delay ms from now. works for event jobs, too.
+void sched_trigger_in(int job, unsigned long delay);
+
+// execute all due jobs, then idle until the next deadline
+void sched_run(void);
+
+int sched_count(void);
+const struct sched_job *sched_get(int job);
+
+#endif // __ESP_ENV_SCHEDULER__
@@ -14,25 +14,45 @@
 #ifndef __SENSORS_H__
 #define __SENSORS_H__
 
-float sht_temp(void);
-float sht_humid(void);
+enum sensor_channels {
+    SENSOR_SHT_TEMP = 0,
+    SENSOR_SHT_HUMID,
+
+#ifdef ENABLE_BME280
+    SENSOR_BME1_TEMP,
+    SENSOR_BME1_HUMID,
+    SENSOR_BME1_PRESSURE,
+    SENSOR_BME2_TEMP,
+    SENSOR_BME2_HUMID,
+    SENSOR_BME2_PRESSURE,
+#endif // ENABLE_BME280
+
+#ifdef ENABLE_CCS811
+    SENSOR_CCS1_ECO2,
+    SENSOR_CCS1_TVOC,
+    SENSOR_CCS2_ECO2,
+    SENSOR_CCS2_TVOC,
+#endif // ENABLE_CCS811
+
+    SENSOR_NUM_CHANNELS
+};
+
+struct sensor_sample {
+    float value;
+    unsigned long time; // millis() of acquisition
+    bool valid;
+};
+
+// last acquired sample, refreshed every SENSOR_HANDLE_INTERVAL
+const struct sensor_sample *sensor_get(enum sensor_channels channel);
+
 extern bool found_sht;
 
 #ifdef ENABLE_BME280
-float bme1_temp(void);
-float bme2_temp(void);
-float bme1_humid(void);
-float bme2_humid(void);
-float bme1_pressure(void);
-float bme2_pressure(void);
 extern bool found_bme1, found_bme2;
 #endif // ENABLE_BME280
 
 #ifdef ENABLE_CCS811
-float ccs1_eco2(void);
-float ccs1_tvoc(void);
-float ccs2_eco2(void);
-float ccs2_tvoc(void);
 extern bool found_ccs1, found_ccs2;
 extern bool ccs1_data_valid, ccs2_data_valid;
 extern int ccs1_error_code, ccs2_error_code;
@@ -61,6 +61,8 @@ struct ui_status {
 
 extern struct ui_status ui_status;
 
+#define UI_FIELD(f) offsetof(struct ui_status, f)
+
 enum ui_state {
     UI_INIT = 0,
     UI_MEMORY_READY,
@@ -76,6 +78,11 @@ void ui_run(void);
 
 void ui_progress(enum ui_state state);
 
+// redraw if the field in struct ui_status is shown on the current page
+void ui_update_field(size_t field);
+
+String ui_stats(void);
+
 #endif // FEATURE_UI
 
 #endif // __UI_H__
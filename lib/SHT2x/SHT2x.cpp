@@ -11,6 +11,11 @@
  SHT2x.ReadTemperature() will return a float containing the temperature in Celsius. Ex: 24.1
  SHT2x.SetResolution(byte: 0b.76543210) sets the resolution of the readings.
 
+ Non-blocking usage:
+ Call startMeasurement(TRIGGER_TEMP_MEASURE_NOHOLD), then call
+ readMeasurement() until it returns true. Convert the raw value with
+ RawToTemperature() or RawToHumidity().
+
   Copyright (C) 2015  Nuno Chaveiro  nchaveiro[at]gmail.com  Lisbon, Portugal
   Copyright (C) 2020  Thomas Buck <thomas@xythobuz.de>
 */
@@ -42,7 +47,7 @@ bool SHT2x::GetAlive(void) {
  * @return float - The relative humidity in %RH
  **********************************************************/
 float SHT2x::GetHumidity(void) {
-    return (-6.0 + 125.0 / 65536.0 * (float)(readSensor(TRIGGER_HUMD_MEASURE_HOLD)));
+    return RawToHumidity(readSensor(TRIGGER_HUMD_MEASURE_HOLD));
 }
 
 /**********************************************************
@@ -52,7 +57,15 @@ float SHT2x::GetHumidity(void) {
  * @return float - The temperature in Deg C
  **********************************************************/
 float SHT2x::GetTemperature(void) {
-    return (-46.85 + 175.72 / 65536.0 * (float)(readSensor(TRIGGER_TEMP_MEASURE_HOLD)));
+    return RawToTemperature(readSensor(TRIGGER_TEMP_MEASURE_HOLD));
+}
+
+float SHT2x::RawToHumidity(uint16_t raw) {
+    return (-6.0 + 125.0 / 65536.0 * (float)(raw));
+}
+
+float SHT2x::RawToTemperature(uint16_t raw) {
+    return (-46.85 + 175.72 / 65536.0 * (float)(raw));
 }
 
 /**********************************************************
@@ -93,8 +106,6 @@ uint8_t SHT2x::read_user_register(void) {
 }
 
 uint16_t SHT2x::readSensor(uint8_t command) {
-    uint16_t result;
-
     wire->beginTransmission(addr); //begin
     wire->write(command);                     //send the pointer location
     wire->endTransmission();                  //end
@@ -113,6 +124,48 @@ uint16_t SHT2x::readSensor(uint8_t command) {
         if(counter > 100) return ERROR_TIMEOUT; //Error timout
     }
 
+    return read_result();
+}
+
+/**********************************************************
+ * startMeasurement
+ *  Triggers a measurement without blocking. Use one of the
+ *  TRIGGER_x_MEASURE_NOHOLD commands, so the sensor releases
+ *  the bus while converting.
+ *
+ * @return bool - true if the sensor acknowledged the command
+ **********************************************************/
+bool SHT2x::startMeasurement(uint8_t command) {
+    wire->beginTransmission(addr);
+    wire->write(command);
+    return (wire->endTransmission() == 0);
+}
+
+/**********************************************************
+ * readMeasurement
+ *  Polls for the result of startMeasurement(). The sensor
+ *  does not acknowledge its read address until the conversion
+ *  is finished, so this returns immediately while busy.
+ *
+ * @return bool - false while busy, true when result is set.
+ *                result may be ERROR_CRC.
+ **********************************************************/
+bool SHT2x::readMeasurement(uint16_t *result) {
+    if (wire->requestFrom(addr, 3) < 3) {
+        // drop partial reads, if any
+        while (wire->available()) {
+            wire->read();
+        }
+        return false;
+    }
+
+    *result = read_result();
+    return true;
+}
+
+uint16_t SHT2x::read_result(void) {
+    uint16_t result;
+
     //Store the result
     result = ((wire->read()) << 8);
     result |= wire->read();
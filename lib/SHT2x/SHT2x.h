@@ -11,6 +11,11 @@
  SHT2x.ReadTemperature() will return a float containing the temperature in Celsius. Ex: 24.1
  SHT2x.SetResolution(byte: 0b.76543210) sets the resolution of the readings.
 
+ Non-blocking usage:
+ Call startMeasurement(TRIGGER_TEMP_MEASURE_NOHOLD), then call
+ readMeasurement() until it returns true. Convert the raw value with
+ RawToTemperature() or RawToHumidity().
+
   Copyright (C) 2015  Nuno Chaveiro  nchaveiro[at]gmail.com  Lisbon, Portugal
   Copyright (C) 2020  Thomas Buck <thomas@xythobuz.de>
 */
@@ -52,7 +57,14 @@ class SHT2x {
         uint8_t  read_user_register(void);
         uint16_t readSensor(uint8_t command);
 
+        bool     startMeasurement(uint8_t command);
+        bool     readMeasurement(uint16_t *result);
+
+        static float RawToHumidity(uint16_t raw);
+        static float RawToTemperature(uint16_t raw);
+
     private:
+        uint16_t read_result(void);
         uint8_t  check_crc(uint16_t message_from_sensor, uint8_t check_value_from_sensor);
 
         uint8_t addr;
@@ -0,0 +1,103 @@
+/*
+ * SensorFilter.cpp
+ *
+ * ESP8266 / ESP32 Environmental Sensor
+ *
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "SensorFilter.h"
+
+SensorFilter::SensorFilter(void)
+        : head(0), count(0), fails(0), filtered(0.0),
+        limit_min(-INFINITY), limit_max(INFINITY), error_count(0) { }
+
+bool SensorFilter::update(sensor_read_t read) {
+    unsigned long start = millis();
+
+    for (int i = 0; i < SENSOR_FILTER_MAX_TRIES; i++) {
+        if (add(read())) {
+            return true;
+        }
+
+        if ((millis() - start) >= SENSOR_FILTER_MAX_TIME) {
+            break;
+        }
+    }
+
+    fail();
+    return false;
+}
+
+bool SensorFilter::add(float sample) {
+    if (!plausible(sample)) {
+        return false;
+    }
+
+    buffer[head] = sample;
+    head = (head + 1) % SENSOR_FILTER_SIZE;
+    if (count < SENSOR_FILTER_SIZE) {
+        count++;
+    }
+    fails = 0;
+
+    calculate();
+    return true;
+}
+
+void SensorFilter::fail(void) {
+    error_count++;
+
+    if (fails < SENSOR_FILTER_MAX_FAILS) {
+        fails++;
+    }
+
+    // don't keep serving stale data from a dead sensor
+    if (error()) {
+        head = 0;
+        count = 0;
+    }
+}
+
+void SensorFilter::reset(void) {
+    head = 0;
+    count = 0;
+    fails = 0;
+}
+
+bool SensorFilter::plausible(float sample) {
+    return (!isnan(sample)) && (sample >= limit_min) && (sample <= limit_max);
+}
+
+void SensorFilter::calculate(void) {
+    float sorted[SENSOR_FILTER_SIZE];
+
+    // insertion sort, buffer is tiny
+    for (int i = 0; i < count; i++) {
+        int j = i;
+        while ((j > 0) && (sorted[j - 1] > buffer[i])) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = buffer[i];
+    }
+
+    int trim = SENSOR_FILTER_TRIM;
+    if ((2 * trim) >= count) {
+        trim = (count - 1) / 2;
+    }
+
+    float sum = 0.0;
+    for (int i = trim; i < (count - trim); i++) {
+        sum += sorted[i];
+    }
+    filtered = sum / (count - (2 * trim));
+}
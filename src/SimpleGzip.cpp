@@ -0,0 +1,202 @@
+/*
+ * SimpleGzip.cpp
+ *
+ * ESP8266 / ESP32 Environmental Sensor
+ *
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "SimpleGzip.h"
+
+// https://www.rfc-editor.org/rfc/rfc1951
+// https://www.rfc-editor.org/rfc/rfc1952
+
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+#define NO_POS 0xFFFF
+
+static const uint16_t length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const uint8_t length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static const uint16_t distance_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577
+};
+
+static const uint8_t distance_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static const uint32_t crc_table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+    0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+    0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+static uint32_t crc32(const uint8_t *data, int len) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (int i = 0; i < len; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ crc_table[crc & 0x0F];
+        crc = (crc >> 4) ^ crc_table[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+static int hash(const uint8_t *p) {
+    return ((p[0] << 6) ^ (p[1] << 3) ^ p[2]) & (SIMPLE_GZIP_HASH_SIZE - 1);
+}
+
+// deflate writes everything LSB first
+void SimpleGzip::putBits(uint32_t bits, int count) {
+    bit_buf |= bits << bit_count;
+    bit_count += count;
+
+    while (bit_count >= 8) {
+        if (out_pos < out_size) {
+            out_buf[out_pos] = bit_buf & 0xFF;
+        }
+        out_pos++;
+        bit_buf >>= 8;
+        bit_count -= 8;
+    }
+}
+
+// except for Huffman codes, which start with their MSB
+void SimpleGzip::putCode(uint32_t code, int count) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < count; i++) {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    putBits(reversed, count);
+}
+
+// fixed literal / length alphabet, see RFC 1951 3.2.6
+void SimpleGzip::putLiteral(int value) {
+    if (value <= 143) {
+        putCode(0x30 + value, 8);
+    } else if (value <= 255) {
+        putCode(0x190 + (value - 144), 9);
+    } else if (value <= 279) {
+        putCode(value - 256, 7);
+    } else {
+        putCode(0xC0 + (value - 280), 8);
+    }
+}
+
+void SimpleGzip::putMatch(int length, int distance) {
+    int i = 28;
+    while (length_base[i] > length) {
+        i--;
+    }
+    putLiteral(257 + i);
+    putBits(length - length_base[i], length_extra[i]);
+
+    i = 29;
+    while (distance_base[i] > distance) {
+        i--;
+    }
+    putCode(i, 5);
+    putBits(distance - distance_base[i], distance_extra[i]);
+}
+
+int SimpleGzip::compress(const uint8_t *in, int len, uint8_t *out, int size) {
+    if (len >= NO_POS) {
+        return -1;
+    }
+
+    out_buf = out;
+    out_size = size;
+    out_pos = 0;
+    bit_buf = 0;
+    bit_count = 0;
+
+    // gzip header, no name and no modification time
+    static const uint8_t header[10] = { 0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF };
+    for (int i = 0; i < 10; i++) {
+        putBits(header[i], 8);
+    }
+
+    // a single final block with fixed codes
+    putBits(1, 1);
+    putBits(1, 2);
+
+    for (int i = 0; i < SIMPLE_GZIP_HASH_SIZE; i++) {
+        hash_table[i] = NO_POS;
+    }
+
+    int pos = 0;
+    while (pos < len) {
+        int match_len = 0, match_dist = 0;
+
+        if ((pos + MIN_MATCH) <= len) {
+            int h = hash(in + pos);
+            int candidate = hash_table[h];
+            hash_table[h] = pos;
+
+            if ((candidate != NO_POS) && ((pos - candidate) <= SIMPLE_GZIP_WINDOW)) {
+                int max = len - pos;
+                if (max > MAX_MATCH) {
+                    max = MAX_MATCH;
+                }
+
+                while ((match_len < max) && (in[candidate + match_len] == in[pos + match_len])) {
+                    match_len++;
+                }
+                match_dist = pos - candidate;
+            }
+        }
+
+        if (match_len >= MIN_MATCH) {
+            putMatch(match_len, match_dist);
+
+            // remember the skipped positions for later matches
+            for (int i = pos + 1; (i < (pos + match_len)) && ((i + MIN_MATCH) <= len); i++) {
+                hash_table[hash(in + i)] = i;
+            }
+            pos += match_len;
+        } else {
+            putLiteral(in[pos]);
+            pos++;
+        }
+
+        if (out_pos > out_size) {
+            return -1;
+        }
+    }
+
+    putLiteral(256); // end of block
+    putBits(0, (8 - bit_count) & 7); // flush the last partial byte
+
+    uint32_t crc = crc32(in, len);
+    for (int i = 0; i < 4; i++) {
+        putBits((crc >> (8 * i)) & 0xFF, 8);
+    }
+    for (int i = 0; i < 4; i++) {
+        putBits((len >> (8 * i)) & 0xFF, 8);
+    }
+
+    if (out_pos > out_size) {
+        return -1;
+    }
+
+    return out_pos;
+}
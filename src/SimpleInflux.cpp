@@ -24,37 +24,280 @@
 WiFiClient client;
 #elif defined(ARDUINO_ARCH_ESP8266)
 #include <ESP8266WiFi.h>
-#include <ESP8266HTTPClient.h>
-#include <WiFiClient.h>
+#include <sys/time.h>
+#elif defined(ARDUINO_ARCH_ESP32)
+#include <WiFi.h>
+#include <sys/time.h>
 #endif
 
-void InfluxData::addTag(const char *name, const char *value) {
-    if (tag_count < SIMPLE_INFLUX_MAX_ELEMENTS) {
-        tag_name[tag_count] = name;
-        tag_value[tag_count] = value;
-        tag_count++;
+// https://docs.influxdata.com/influxdb/v1.8/reference/syntax/line-protocol/
+
+#define ESCAPE_NAME ", "
+#define ESCAPE_KEY ",= "
+
+static int escapedLength(const char *s, const char *special) {
+    int len = 0;
+    for (; *s; s++) {
+        len += strchr(special, *s) ? 2 : 1;
+    }
+    return len;
+}
+
+// open a gap of len bytes at pos, if the buffer is large enough
+boolean InfluxLine::makeRoom(int pos, int len) {
+    if ((line_length + len) > buffer_size) {
+        overflow = true;
+        return false;
+    }
+
+    memmove(buffer + pos + len, buffer + pos, line_length - pos);
+    line_length += len;
+    return true;
+}
+
+// write s at pos without checking the size, returns the next position
+int InfluxLine::put(int pos, const char *s, const char *special) {
+    for (; *s; s++) {
+        if (special && strchr(special, *s)) {
+            buffer[pos++] = '\\';
+        }
+        buffer[pos++] = *s;
+    }
+    return pos;
+}
+
+void InfluxLine::setName(const char *n) {
+    int len = escapedLength(n, ESCAPE_NAME);
+    int diff = len - name_length;
+
+    if (diff > 0) {
+        if (!makeRoom(name_length, diff)) {
+            return;
+        }
+    } else if (diff < 0) {
+        memmove(buffer + len, buffer + name_length, line_length - name_length);
+        line_length += diff;
+    }
+
+    put(0, n, ESCAPE_NAME);
+    name_length = len;
+    tags_end += diff;
+}
+
+boolean InfluxLine::addTag(const char *name, const char *value) {
+    // tags go before the values, which may have been added already
+    int len = 1 + escapedLength(name, ESCAPE_KEY) + 1 + escapedLength(value, ESCAPE_KEY);
+    if (!makeRoom(tags_end, len)) {
+        return false;
+    }
+
+    int pos = tags_end;
+    buffer[pos++] = ',';
+    pos = put(pos, name, ESCAPE_KEY);
+    buffer[pos++] = '=';
+    put(pos, value, ESCAPE_KEY);
+
+    tags_end += len;
+    return true;
+}
+
+boolean InfluxLine::addValue(const char *name, double value) {
+    // Influx refuses nan and inf, also keeps the string short
+    if (!(fabs(value) < 1e15)) {
+        return false;
+    }
+
+    char num[24];
+    dtostrf(value, 1, 2, num);
+
+    int len = 1 + escapedLength(name, ESCAPE_KEY) + 1 + strlen(num);
+    if (!makeRoom(line_length, len)) {
+        return false;
+    }
+
+    int pos = line_length - len;
+    buffer[pos++] = (value_count == 0) ? ' ' : ',';
+    pos = put(pos, name, ESCAPE_KEY);
+    buffer[pos++] = '=';
+    put(pos, num, NULL);
+
+    value_count++;
+    return true;
+}
+
+void Influxdb::prepare(InfluxLine &data) {
+    if (data.overflowed() || (data.valueCount() == 0)) {
+        if (verbose) {
+            debug.println(F("Influx point incomplete"));
+        }
+        dropped_lines++;
+        return;
+    }
+
+    prepare(data.line(), data.length(), data.time());
+}
+
+void Influxdb::prepare(const char *line, int line_len, uint64_t time_ms) {
+    char timestamp[20];
+    int timestamp_len = 0;
+
+#if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
+    // the timestamp is optional, but queued points need it
+    if (time_ms == 0) {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        if (tv.tv_sec >= SIMPLE_INFLUX_VALID_TIME) {
+            time_ms = (uint64_t)tv.tv_sec * 1000 + (tv.tv_usec / 1000);
+        }
+    }
+
+    if (time_ms != 0) {
+        timestamp[0] = ' ';
+        ultoa((unsigned long)(time_ms / 1000), timestamp + 1, 10);
+        timestamp_len = strlen(timestamp);
+
+        if (precision == INFLUX_PRECISION_MS) {
+            int ms = time_ms % 1000;
+            timestamp[timestamp_len++] = '0' + (ms / 100);
+            timestamp[timestamp_len++] = '0' + ((ms / 10) % 10);
+            timestamp[timestamp_len++] = '0' + (ms % 10);
+        }
+    }
+#endif
+
+    int len = line_len + timestamp_len + 1;
+    if ((len > SIMPLE_INFLUX_MAX_BATCH) || (len > SIMPLE_INFLUX_QUEUE_SIZE)) {
+        if (verbose) {
+            debug.println(F("Influx point too long"));
+        }
+        dropped_lines++;
+        return;
+    }
+
+#if defined(ARDUINO_ARCH_AVR)
+    // the small queue is no batch, so send before anything gets dropped
+    if ((queue_used + len) > SIMPLE_INFLUX_QUEUE_SIZE) {
+        write();
+    }
+#endif
+
+    while ((queue_used + len) > SIMPLE_INFLUX_QUEUE_SIZE) {
+        dropOldest();
+    }
+
+    push(line, line_len);
+    push(timestamp, timestamp_len);
+    push("\n", 1);
+    queue_lines++;
+}
+
+boolean Influxdb::write(InfluxLine &data) {
+    prepare(data);
+    return write();
+}
+
+boolean Influxdb::write(void) {
+    for (int i = 0; (i < SIMPLE_INFLUX_MAX_DRAIN) && (queue_used > 0); i++) {
+        int len = peek(SIMPLE_INFLUX_MAX_BATCH);
+
+        enum influx_send_result r = send(len);
+        if (r == INFLUX_RETRY) {
+            // try again on the next write cycle
+            return false;
+        }
+
+        int lines = discard(len);
+
+        if (r == INFLUX_REJECTED) {
+            rejected_lines += lines;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// append to the queue, the caller has to make room first
+void Influxdb::push(const char *data, int len) {
+    int first = SIMPLE_INFLUX_QUEUE_SIZE - queue_head;
+    if (first > len) {
+        first = len;
+    }
+
+    memcpy(queue + queue_head, data, first);
+    memcpy(queue, data + first, len - first);
+
+    queue_head = (queue_head + len) % SIMPLE_INFLUX_QUEUE_SIZE;
+    queue_used += len;
+}
+
+// copy len bytes from the front of the queue, without removing them
+void Influxdb::copyOut(char *dst, int len) {
+    int first = SIMPLE_INFLUX_QUEUE_SIZE - queue_tail;
+    if (first > len) {
+        first = len;
     }
+
+    memcpy(dst, queue + queue_tail, first);
+    memcpy(dst + first, queue, len - first);
 }
 
-void InfluxData::addValue(const char *name, double value) {
-    if (value_count < SIMPLE_INFLUX_MAX_ELEMENTS) {
-        value_name[value_count] = name;
-        value_value[value_count] = value;
-        value_count++;
+void Influxdb::dropOldest(void) {
+    int len = 0;
+    while (len < queue_used) {
+        len++;
+        if (queue[(queue_tail + len - 1) % SIMPLE_INFLUX_QUEUE_SIZE] == '\n') {
+            break;
+        }
     }
+
+    discard(len);
+    dropped_lines++;
 }
 
-// https://docs.influxdata.com/influxdb/v1.8/guides/write_data/
+// length of as many complete lines as fit into max bytes
+int Influxdb::peek(int max) {
+    int len = 0, line = 0;
 
-boolean Influxdb::write(InfluxData &data) {
-    //debug.print(F("Writing "));
-    //debug.println(data.dataName());
+    while ((len + line) < queue_used) {
+        char c = queue[(queue_tail + len + line) % SIMPLE_INFLUX_QUEUE_SIZE];
+        line++;
 
+        if (c == '\n') {
+            if ((len + line) > max) {
+                break;
+            }
+            len += line;
+            line = 0;
+        }
+    }
+
+    return len;
+}
+
+// remove len bytes of complete lines from the front of the queue, returns the lines
+int Influxdb::discard(int len) {
+    int lines = 0;
+    for (int i = 0; i < len; i++) {
+        if (queue[(queue_tail + i) % SIMPLE_INFLUX_QUEUE_SIZE] == '\n') {
+            lines++;
+        }
+    }
+
+    queue_lines -= lines;
+    queue_tail = (queue_tail + len) % SIMPLE_INFLUX_QUEUE_SIZE;
+    queue_used -= len;
+    return lines;
+}
+
+enum influx_send_result Influxdb::send(int len) {
 #if defined(ARDUINO_ARCH_AVR)
 
     client.stop();
 
     if (client.connect(db_host, db_port)) {
+        new_connections++;
+
         client.print(F("POST /write?db="));
         client.print(db_name);
         client.println(F(" HTTP/1.1"));
@@ -62,45 +305,25 @@ boolean Influxdb::write(InfluxData &data) {
         client.print(F("Host: "));
         client.print(db_host);
         client.print(F(":"));
-        client.println(String(db_port));
+        client.println(db_port);
 
         client.println(F("Connection: close"));
 
-        int len = strlen(data.dataName()) + 1;
-        for (int i = 0; i < data.tagCount(); i++) {
-            len += strlen(data.tagName(i)) + strlen(data.tagValue(i)) + 2;
-        }
-        for (int i = 0; i < data.valueCount(); i++) {
-            len += strlen(data.valueName(i)) + String(data.valueValue(i)).length() + 1;
-            if (i > 0) {
-                len += 1;
-            }
-        }
-
         client.print(F("Content-Length: "));
-        client.println(String(len));
+        client.println(len);
 
         client.println();
 
-        client.print(data.dataName());
-        for (int i = 0; i < data.tagCount(); i++) {
-            client.print(F(","));
-            client.print(data.tagName(i));
-            client.print(F("="));
-            //client.print(F("\""));
-            client.print(data.tagValue(i));
-            //client.print(F("\""));
-        }
-        client.print(F(" "));
-        for (int i = 0; i < data.valueCount(); i++) {
-            if (i > 0) {
-                client.print(F(","));
-            }
-            client.print(data.valueName(i));
-            client.print(F("="));
-            client.print(data.valueValue(i));
+        // stream the body straight from the queue, in at most two pieces
+        int first = SIMPLE_INFLUX_QUEUE_SIZE - queue_tail;
+        if (first > len) {
+            first = len;
         }
-        // we're leaving out the timestamp, it's optional
+        client.write((const uint8_t *)(queue + queue_tail), first);
+        client.write((const uint8_t *)queue, len - first);
+
+        body_bytes += len;
+        sent_bytes += len;
 
         boolean currentLineIsBlank = true, contains_error = false;
         int compare_off = 0;
@@ -108,7 +331,7 @@ boolean Influxdb::write(InfluxData &data) {
         while (client.connected()) {
             if (client.available()) {
                 char c = client.read();
-                if (c != '\r') {
+                if (verbose && (c != '\r')) {
                     debug.write(c);
                 }
 
@@ -138,73 +361,126 @@ boolean Influxdb::write(InfluxData &data) {
         }
 
         client.stop();
-        debug.println(contains_error ? F("Request failed") : F("Request Done"));
-        return !contains_error;
+        if (verbose) {
+            debug.println(contains_error ? F("Request failed") : F("Request Done"));
+        }
+        last_response = contains_error ? 400 : 204;
+        return contains_error ? INFLUX_REJECTED : INFLUX_SENT;
     } else {
-        debug.println(F("Error connecting"));
-        return false; // failed
+        if (verbose) {
+            debug.println(F("Error connecting"));
+        }
+        last_response = -1;
+        return INFLUX_RETRY; // failed
     }
 
-#elif defined(ARDUINO_ARCH_ESP8266)
+#elif defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
 
-    String content = data.dataName();
-    for (int i = 0; i < data.tagCount(); i++) {
-        content += F(",");
-        content += data.tagName(i);
-        content += F("=");
-        //content += F("\"");
-        content += data.tagValue(i);
-        //content += F("\"");
-    }
-    content += F(" ");
-    for (int i = 0; i < data.valueCount(); i++) {
-        if (i > 0) {
-            content += F(",");
-        }
-        content += data.valueName(i);
-        content += F("=");
-        content += data.valueValue(i);
+    // don't rely on a connection the server has most likely dropped already
+    if (client.connected() && ((millis() - last_request) >= SIMPLE_INFLUX_IDLE_TIMEOUT)) {
+        client.stop();
     }
-    // we're leaving out the timestamp, it's optional
+    last_request = millis();
 
-    WiFiClient client;
-    HTTPClient http;
+    copyOut(batch, len);
 
-    http.setReuse(false);
-    http.setTimeout(1500); // ms
+    uint8_t *body = (uint8_t *)batch;
+    int body_len = len;
+
+#ifdef SIMPLE_INFLUX_GZIP
+    int compressed = gzip.compress(body, len, gzip_batch, sizeof(gzip_batch));
+    if ((compressed > 0) && (compressed < len)) {
+        body = gzip_batch;
+        body_len = compressed;
+    }
+#endif
 
     String uri("/write?db=");
     uri += db_name;
+    uri += (precision == INFLUX_PRECISION_MS) ? F("&precision=ms") : F("&precision=s");
+
+    int httpResponseCode = -1;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        boolean reused = client.connected();
+
+        http.setReuse(true);
+        http.setTimeout(1500); // ms
+#if defined(ARDUINO_ARCH_ESP32)
+        http.setConnectTimeout(1500); // ms, defaults to 5s
+#endif
+        http.begin(client, db_host, db_port, uri, false);
+
+        if (body != (uint8_t *)batch) {
+            http.addHeader(F("Content-Encoding"), F("gzip"));
+        }
+
+        httpResponseCode = http.POST(body, body_len);
+
+        if (reused) {
+            reused_connections++;
+        } else {
+            new_connections++;
+        }
 
-    http.begin(client, db_host, db_port, uri, false);
+        // kept-alive socket closed by the server, try again with a new one
+        if ((httpResponseCode < 0) && reused) {
+            http.end();
+            client.stop();
+            continue;
+        }
 
-    //debug.print(F("Sending to Influx: "));
-    //debug.println(content);
+        break;
+    }
 
-    int httpResponseCode = http.POST(content);
     String payload = http.getString();
 
+    body_bytes += len;
+    sent_bytes += body_len;
+    last_response = httpResponseCode;
+
     String compare_to(F("X-Influxdb-Error"));
-    bool result = false; // error
+    enum influx_send_result result = INFLUX_RETRY; // error
 
     if ((httpResponseCode >= 200) && (httpResponseCode <= 299)
             && (payload.indexOf(compare_to) < 0)) {
-        result = true; // success
+        result = INFLUX_SENT; // success
     } else {
-        debug.print(F("Got "));
-        debug.print(httpResponseCode);
-        debug.print(F(" response from Influx: "));
-        debug.println(payload);
+        switch (httpResponseCode) {
+            case 400: // malformed or partially written
+            case 401: // bad credentials
+            case 403:
+            case 404: // no such database
+            case 413: // batch too large
+            case 422: // outside of the retention policy
+                // sending the same batch again won't help
+                result = INFLUX_REJECTED;
+                break;
+
+            default:
+                // transport errors, 429 and 5xx, keep the data
+                break;
+        }
+
+        if (verbose) {
+            debug.print(F("Got "));
+            debug.print(httpResponseCode);
+            debug.print(F(" response from Influx: "));
+            debug.println(payload);
+        }
     }
 
+    // keeps the connection open, if the server allows it
     http.end();
+
+    if (result != INFLUX_SENT) {
+        client.stop();
+    }
+
     return result;
 
-#elif defined(ARDUINO_ARCH_ESP32)
-#error Not implemented for ESP32 yet
 #else
 
-    return true; // success
+    return INFLUX_SENT; // success
 
 #endif
 }
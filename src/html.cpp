@@ -39,6 +39,11 @@
 #include "memory.h"
 #include "relais.h"
 #include "moisture.h"
+#include "influx.h"
+#include "mqtt.h"
+#include "ui.h"
+#include "scheduler.h"
+#include "profiler.h"
 #include "html.h"
 
 #if defined(ARDUINO_ARCH_AVR)
@@ -59,6 +64,14 @@
 #define ARDUINO_SEND_PARTIAL_PAGE() while (false) { }
 #endif
 
+static String sensorString(enum sensor_channels channel) {
+    const struct sensor_sample *s = sensor_get(channel);
+    if (!s->valid) {
+        return String(F("?"));
+    }
+    return String(s->value);
+}
+
 #if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
 void handlePage(int mode, int id) {
 #else
@@ -175,13 +188,13 @@ void handlePage(WiFiClient &client, int mode, int id) {
         message += F("BME280 Low:");
         message += F("\n<br>\n");
         message += F("Temperature: ");
-        message += String(bme1_temp());
+        message += sensorString(SENSOR_BME1_TEMP);
         message += F("\n<br>\n");
         message += F("Humidity: ");
-        message += String(bme1_humid());
+        message += sensorString(SENSOR_BME1_HUMID);
         message += F("\n<br>\n");
         message += F("Pressure: ");
-        message += String(bme1_pressure());
+        message += sensorString(SENSOR_BME1_PRESSURE);
         message += F("\n<br>\n");
         message += F("Offset: ");
         message += String(config.bme1_temp_off);
@@ -200,13 +213,13 @@ void handlePage(WiFiClient &client, int mode, int id) {
         message += F("BME280 High:");
         message += F("\n<br>\n");
         message += F("Temperature: ");
-        message += String(bme2_temp());
+        message += sensorString(SENSOR_BME2_TEMP);
         message += F("\n<br>\n");
         message += F("Humidity: ");
-        message += String(bme2_humid());
+        message += sensorString(SENSOR_BME2_HUMID);
         message += F("\n<br>\n");
         message += F("Pressure: ");
-        message += String(bme2_pressure());
+        message += sensorString(SENSOR_BME2_PRESSURE);
         message += F("\n<br>\n");
         message += F("Offset: ");
         message += String(config.bme2_temp_off);
@@ -229,10 +242,10 @@ void handlePage(WiFiClient &client, int mode, int id) {
         message += F("SHT21:");
         message += F("\n<br>\n");
         message += F("Temperature: ");
-        message += String(sht_temp());
+        message += sensorString(SENSOR_SHT_TEMP);
         message += F("\n<br>\n");
         message += F("Humidity: ");
-        message += String(sht_humid());
+        message += sensorString(SENSOR_SHT_HUMID);
         message += F("\n<br>\n");
         message += F("Offset: ");
         message += String(config.sht_temp_off);
@@ -253,11 +266,11 @@ void handlePage(WiFiClient &client, int mode, int id) {
         message += F("CCS811 Low:");
         message += F("\n<br>\n");
         message += F("eCO2: ");
-        message += String(ccs1_eco2());
+        message += sensorString(SENSOR_CCS1_ECO2);
         message += F("ppm");
         message += F("\n<br>\n");
         message += F("TVOC: ");
-        message += String(ccs1_tvoc());
+        message += sensorString(SENSOR_CCS1_TVOC);
         message += F("ppb");
 
         if (!ccs1_data_valid) {
@@ -276,11 +289,11 @@ void handlePage(WiFiClient &client, int mode, int id) {
         message += F("CCS811 High:");
         message += F("\n<br>\n");
         message += F("eCO2: ");
-        message += String(ccs2_eco2());
+        message += sensorString(SENSOR_CCS2_ECO2);
         message += F("ppm");
         message += F("\n<br>\n");
         message += F("TVOC: ");
-        message += String(ccs2_tvoc());
+        message += sensorString(SENSOR_CCS2_TVOC);
         message += F("ppb");
 
         if (!ccs2_data_valid) {
@@ -370,15 +383,54 @@ void handlePage(WiFiClient &client, int mode, int id) {
     message += INFLUXDB_HOST;
     message += F(":");
     message += String(INFLUXDB_PORT);
+    message += F("<br>");
+    message += influxStatus();
 #else
     message += F("InfluxDB logging not enabled!");
 #endif
     message += F("</p>");
 
+#ifdef ENABLE_MQTT
+    message += F("<p>MQTT: ");
+    message += MQTT_HOST;
+    message += F(":");
+    message += String(MQTT_PORT);
+    message += F("<br>");
+    message += mqttStatus();
+    message += F("</p>");
+#endif // ENABLE_MQTT
+
+#ifdef FEATURE_UI
+    message += F("<p>UI ");
+    message += ui_stats();
+    message += F("</p>");
+#endif // FEATURE_UI
+
+    message += F("<p>Scheduler (runs / max. late):");
+    for (int i = 0; i < sched_count(); i++) {
+        const struct sched_job *j = sched_get(i);
+        message += F("<br>");
+        message += j->name;
+        message += F(": ");
+        message += String(j->runs);
+        message += F(" / ");
+        message += String(j->max_late);
+        message += F("ms");
+    }
+    message += F("</p>");
+
+    ARDUINO_SEND_PARTIAL_PAGE();
+
     message += F("<p>Uptime: ");
     message += String(millis() / 1000);
     message += F(" sec.</p>");
 
+#ifdef FEATURE_PROFILER
+    message += F("<p>");
+    message += F("Try <a href=\"/profile\">/profile</a> for loop timing statistics!");
+    message += F("</p>");
+#endif // FEATURE_PROFILER
+
 #ifdef ENABLE_DEBUGLOG
     message += F("<hr><p>Debug Log:</p>");
     message += F("<div class='log'><pre id='logbuf'>");
@@ -414,6 +466,70 @@ void handlePage(WiFiClient &client, int mode, int id) {
 #endif
 }
 
+#ifdef FEATURE_PROFILER
+void handleProfile() {
+    if (server.hasArg("reset")) {
+        prof_reset();
+    }
+
+    String message;
+    message += F("<!DOCTYPE html>");
+    message += F("<html><head>");
+    message += F("<meta charset='utf-8'/>");
+    message += F("<meta name='viewport' content='width=device-width, initial-scale=1'/>");
+    message += F("<title>" ESP_PLATFORM_NAME " " NAME_OF_FEATURE " Profile</title>");
+    message += F("<style>");
+    message += F("td, th { padding: 0 0.5em; text-align: right; }");
+    message += F("@media (prefers-color-scheme: dark) {");
+    message += F(    "body {");
+    message += F(        "background-color: black;");
+    message += F(        "color: white;");
+    message += F(    "}");
+    message += F(    "a:link { color: yellow; }");
+    message += F(    "a:visited { color: orange; }");
+    message += F("}");
+    message += F("</style>");
+    message += F("</head><body>");
+    message += F("<h1>Loop Profile</h1>");
+    message += F("<p>All times in us. Histogram bucket n counts runs taking 2^n to 2^(n+1) us.</p>");
+
+    message += F("<table><tr><th>Job</th><th>Runs</th><th>Min</th><th>Mean</th><th>Max</th>");
+    for (int b = 0; b < PROF_BUCKETS; b++) {
+        message += F("<th>");
+        message += String(b);
+        message += F("</th>");
+    }
+    message += F("</tr>\n");
+
+    for (int i = 0; i < prof_count(); i++) {
+        const struct prof_stats *s = prof_get(i);
+        message += F("<tr><td>");
+        message += s->name;
+        message += F("</td><td>");
+        message += String(s->count);
+        message += F("</td><td>");
+        message += (s->count > 0) ? String(s->min) : String(F("-"));
+        message += F("</td><td>");
+        message += (s->count > 0) ? String((unsigned long)(s->sum / s->count)) : String(F("-"));
+        message += F("</td><td>");
+        message += String(s->max);
+        message += F("</td>");
+        for (int b = 0; b < PROF_BUCKETS; b++) {
+            message += F("<td>");
+            message += String(s->hist[b]);
+            message += F("</td>");
+        }
+        message += F("</tr>\n");
+    }
+
+    message += F("</table>");
+    message += F("<p><a href=\"/profile?reset=1\">Reset statistics</a></p>");
+    message += F("<p>Go <a href=\"/\">back</a> to start.</p>");
+    message += F("</body></html>");
+    server.send(200, "text/html", message);
+}
+#endif // FEATURE_PROFILER
+
 #if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
 void handleReset() {
     String message;
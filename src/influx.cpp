@@ -19,6 +19,8 @@
 #include "relais.h"
 #include "moisture.h"
 #include "ui.h"
+#include "scheduler.h"
+#include "led.h"
 #include "influx.h"
 
 #ifdef ENABLE_INFLUXDB_LOGGING
@@ -48,21 +50,142 @@
 #include "SimpleInflux.h"
 #endif
 
+#if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
+#include <sys/time.h>
+#endif
+
+// anything before this is a clock that has not been set yet (2020-09-13)
+#define INFLUX_VALID_TIME 1600000000
+
 static Influxdb influx(INFLUXDB_HOST, INFLUXDB_PORT);
 static int error_count = 0;
-static unsigned long last_db_write_time = 0;
+static int influx_job = -1;
+
+#ifdef FEATURE_INFLUX_TASK
+
+/*
+ * On the ESP32 the HTTP requests run in their own task, so a slow or
+ * unreachable server does not stall loop(). Points are serialized in
+ * the loop and handed over in a fixed-size queue.
+ */
+struct influx_line {
+    int length;
+    uint64_t time; // ms since the epoch, 0 if unknown
+    char data[INFLUX_TASK_LINE_SIZE + 1];
+};
+
+static QueueHandle_t write_queue = NULL;
+static volatile unsigned long queue_dropped = 0;
+static volatile int queue_max_depth = 0;
+
+/*
+ * Only the writer task counts its failed requests, runInflux() picks them
+ * up in the loop. The task must not log or touch anything else loop()
+ * uses, DebugLog and the LED are not thread-safe.
+ */
+static volatile unsigned long task_errors = 0;
+static unsigned long task_errors_seen = 0;
+
+#ifdef USE_INFLUXDB_LIB
+static String task_body; // the lines of the next request, only used by the writer task
+#endif // USE_INFLUXDB_LIB
+
+static void influxTask(void *arg);
+
+#endif // FEATURE_INFLUX_TASK
+
+// to compare the backends, see influxStatus()
+static unsigned long last_write_time = 0;
+static unsigned long max_write_time = 0;
 
 void initInflux() {
     influx.setDb(INFLUXDB_DATABASE);
+
+#ifndef USE_INFLUXDB_LIB
+    influx.setPrecision(INFLUX_PRECISION_MS);
+#ifdef FEATURE_INFLUX_TASK
+    influx.setVerbose(false);
+#endif // FEATURE_INFLUX_TASK
+#endif // ! USE_INFLUXDB_LIB
+
+#ifdef FEATURE_INFLUX_TASK
+    write_queue = xQueueCreate(INFLUX_TASK_QUEUE_LEN, sizeof(struct influx_line));
+    xTaskCreate(influxTask, "influx", 8192, NULL, 1, NULL);
+#endif // FEATURE_INFLUX_TASK
+
+    influx_job = sched_add("influx", runInflux, DB_WRITE_INTERVAL);
+}
+
+void requestDatabaseWrite() {
+    sched_trigger(influx_job);
+}
+
+String influxStatus() {
+    String s;
+    s += F("Errors: ");
+    s += String(error_count);
+    s += F(", Write time last / max: ");
+    s += String(last_write_time);
+    s += F(" / ");
+    s += String(max_write_time);
+    s += F("ms");
+
+#ifndef USE_INFLUXDB_LIB
+    s += F(", Connections new / reused: ");
+    s += String(influx.newConnections());
+    s += F(" / ");
+    s += String(influx.reusedConnections());
+    s += F("<br>Queued points: ");
+    s += String(influx.queuedPoints());
+    s += F(", dropped: ");
+    s += String(influx.droppedPoints());
+    s += F(", rejected: ");
+    s += String(influx.rejectedPoints());
+    s += F(" (last response ");
+    s += String(influx.lastResponse());
+    s += F(")");
+    s += F("<br>Body bytes / sent: ");
+    s += String(influx.bodyBytes());
+    s += F(" / ");
+    s += String(influx.sentBytes());
+#endif // USE_INFLUXDB_LIB
+
+#ifdef FEATURE_INFLUX_TASK
+    s += F("<br>Writer queue: ");
+    s += String(uxQueueMessagesWaiting(write_queue));
+    s += F(" / ");
+    s += String(INFLUX_TASK_QUEUE_LEN);
+    s += F(", max: ");
+    s += String(queue_max_depth);
+    s += F(", dropped: ");
+    s += String(queue_dropped);
+#endif // FEATURE_INFLUX_TASK
+
+    return s;
+}
+
+static void influxError(unsigned long count) {
+    error_count += count;
+    led_set(LED_PATTERN_ERROR);
 }
 
 void runInflux() {
-    unsigned long time = millis();
+#ifdef FEATURE_INFLUX_TASK
+    unsigned long errors = task_errors;
+    if (errors != task_errors_seen) {
+#ifdef USE_INFLUXDB_LIB
+        debug.printf("Influx writes failed: %lu\n", errors - task_errors_seen);
+#else
+        debug.printf("Influx writes failed: %lu, last response: %d\n",
+                errors - task_errors_seen, influx.lastResponse());
+#endif // USE_INFLUXDB_LIB
 
-    if ((time - last_db_write_time) >= DB_WRITE_INTERVAL) {
-        last_db_write_time = time;
-        writeDatabase();
+        influxError(errors - task_errors_seen);
+        task_errors_seen = errors;
     }
+#endif // FEATURE_INFLUX_TASK
+
+    writeDatabase();
 
 #ifdef INFLUX_MAX_ERRORS_RESET
     if (error_count >= INFLUX_MAX_ERRORS_RESET) {
@@ -76,48 +199,201 @@ void runInflux() {
 #endif // INFLUX_MAX_ERRORS_RESET
 }
 
-static boolean writeMeasurement(InfluxData &measurement) {
-    boolean success = influx.write(measurement);
-    if (!success) {
-        error_count++;
-        for (int i = 0; i < 10; i++) {
-            digitalWrite(BUILTIN_LED_PIN, LOW); // LED on
-            delay(LED_ERROR_BLINK_INTERVAL);
-            digitalWrite(BUILTIN_LED_PIN, HIGH); // LED off
-            delay(LED_ERROR_BLINK_INTERVAL);
+static int batch_count = 0;
+
+// wall clock in ms since the epoch at a millis() timestamp, 0 if unknown
+static uint64_t wallTime(unsigned long ms) {
+#if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    if (tv.tv_sec < INFLUX_VALID_TIME) {
+        return 0;
+    }
+
+    uint64_t now = (uint64_t)tv.tv_sec * 1000 + (tv.tv_usec / 1000);
+    return now - (millis() - ms);
+#else
+    return 0;
+#endif
+}
+
+// send the prepared points, blocks until the server answered. no logging, runs in the writer task.
+static boolean sendMeasurements() {
+    unsigned long start = millis();
+#if defined(USE_INFLUXDB_LIB) && defined(FEATURE_INFLUX_TASK)
+    boolean success = influx.write(task_body);
+    task_body = "";
+#else
+    boolean success = influx.write();
+#endif
+
+    last_write_time = millis() - start;
+    if (last_write_time > max_write_time) {
+        max_write_time = last_write_time;
+    }
+
+    return success;
+}
+
+#ifdef FEATURE_INFLUX_TASK
+
+static void influxTask(void *arg) {
+    struct influx_line line;
+
+    while (1) {
+        xQueueReceive(write_queue, &line, portMAX_DELAY);
+
+        // everything that arrived in the meantime goes into the same request
+        do {
+#ifdef USE_INFLUXDB_LIB
+            if (task_body.length() > 0) {
+                task_body += '\n';
+            }
+            task_body += line.data;
+#else
+            influx.prepare(line.data, line.length, line.time);
+#endif // USE_INFLUXDB_LIB
+        } while (xQueueReceive(write_queue, &line, 0) == pdTRUE);
+
+        if (!sendMeasurements()) {
+            task_errors++;
         }
     }
+}
+
+#endif // FEATURE_INFLUX_TASK
+
+// queue a point for the next flushMeasurements(), acquired at millis()
+static void addMeasurement(InfluxData &measurement, unsigned long acquired) {
+    uint64_t time = wallTime(acquired);
+
+#ifdef USE_INFLUXDB_LIB
+    // the library writes with its default precision of ns
+    if (time != 0) {
+        measurement.setTime(time * 1000000ULL);
+    }
+#else
+    measurement.setTime(time);
+#endif // USE_INFLUXDB_LIB
+
+#ifdef FEATURE_INFLUX_TASK
+    struct influx_line line;
+    line.time = time;
+
+#ifdef USE_INFLUXDB_LIB
+    String s = measurement.toString();
+    line.length = s.length();
+    const char *data = s.c_str();
+#else
+    line.length = measurement.overflowed() ? 0 : measurement.length();
+    const char *data = measurement.line();
+#endif // USE_INFLUXDB_LIB
+
+    if ((line.length <= 0) || (line.length > INFLUX_TASK_LINE_SIZE)) {
+        debug.println(F("Influx point too long"));
+        queue_dropped++;
+        return;
+    }
+    memcpy(line.data, data, line.length);
+    line.data[line.length] = '\0';
+
+    if (xQueueSend(write_queue, &line, 0) != pdTRUE) {
+        debug.println(F("Influx writer queue full"));
+        queue_dropped++;
+        return;
+    }
+
+    int depth = uxQueueMessagesWaiting(write_queue);
+    if (depth > queue_max_depth) {
+        queue_max_depth = depth;
+    }
+#else
+    influx.prepare(measurement);
+#endif // FEATURE_INFLUX_TASK
+
+    batch_count++;
+}
+
+// send all queued points in a single request
+static boolean flushMeasurements() {
+    if (batch_count == 0) {
+        return true;
+    }
+
+    debug.print(F("Writing "));
+    debug.print(batch_count);
+    debug.println(F(" points"));
+    batch_count = 0;
+
+#ifdef FEATURE_INFLUX_TASK
+    // the writer task has already been woken up by the queue
+    return true;
+#else
+    boolean success = sendMeasurements();
+    if (!success) {
+        influxError(1);
+    }
     return success;
+#endif // FEATURE_INFLUX_TASK
+}
+
+static boolean writeMeasurement(InfluxData &measurement) {
+    addMeasurement(measurement, millis());
+    return flushMeasurements();
+}
+
+#if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
+// does not change, so don't ask WiFi for a new String on every point
+static const char *macAddress() {
+    static char mac[18] = "";
+    if (mac[0] == '\0') {
+        strncpy(mac, WiFi.macAddress().c_str(), sizeof(mac) - 1);
+    }
+    return mac;
 }
+#endif
 
 static void addTagsGeneric(InfluxData &measurement) {
     measurement.addTag("location", SENSOR_LOCATION);
     measurement.addTag("location-id", SENSOR_ID);
 
 #if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
-    measurement.addTag("device", WiFi.macAddress().c_str());
+    measurement.addTag("device", macAddress());
 #endif
 }
 
-static void addTagsSensor(InfluxData &measurement, String sensor, String placement) {
+static void addTagsSensor(InfluxData &measurement, const char *sensor, const char *placement) {
     addTagsGeneric(measurement);
     measurement.addTag("sensor", sensor);
     measurement.addTag("placement", placement);
 }
 
+// adds a cached sensor sample, returns 1 if it was valid
+static int addSample(InfluxData &measurement, const char *key, enum sensor_channels channel,
+        unsigned long &acquired) {
+    const struct sensor_sample *s = sensor_get(channel);
+    if (!s->valid) {
+        return 0;
+    }
+
+    measurement.addValue(key, s->value);
+    acquired = s->time;
+    return 1;
+}
+
 #ifdef FEATURE_RELAIS
-static void addTagsRelais(InfluxData &measurement, String id, String name) {
+static void addTagsRelais(InfluxData &measurement, const char *id, const char *name) {
     addTagsGeneric(measurement);
     measurement.addTag("id", id);
     measurement.addTag("name", name);
 }
 #endif
 
-void writeSensorDatum(String measurement, String sensor, String placement, String key, double value) {
-    InfluxData ms(measurement.c_str());
+void writeSensorDatum(const char *measurement, const char *sensor, const char *placement, const char *key, double value) {
+    InfluxData ms(measurement);
     addTagsSensor(ms, sensor, placement);
 
-    ms.addValue(key.c_str(), value);
+    ms.addValue(key, value);
 
     debug.print("Writing ");
     debug.print(measurement);
@@ -146,74 +422,91 @@ void writeDatabase() {
 
     if (found_bme1) {
         InfluxData measurement("environment");
-        addTagsSensor(measurement, F("bme280"), F("1"));
+        addTagsSensor(measurement, "bme280", "1");
 
-        measurement.addValue("temperature", bme1_temp());
-        measurement.addValue("pressure", bme1_pressure());
-        measurement.addValue("humidity", bme1_humid());
+        int values = 0;
+        unsigned long acquired = 0;
+        values += addSample(measurement, "temperature", SENSOR_BME1_TEMP, acquired);
+        values += addSample(measurement, "pressure", SENSOR_BME1_PRESSURE, acquired);
+        values += addSample(measurement, "humidity", SENSOR_BME1_HUMID, acquired);
 
-        debug.println(F("Writing bme1"));
-        writeMeasurement(measurement);
-        debug.println(F("Done!"));
+        if (values > 0) {
+            debug.println(F("Adding bme1"));
+            addMeasurement(measurement, acquired);
+        }
     }
 
     if (found_bme2) {
         InfluxData measurement("environment");
-        addTagsSensor(measurement, F("bme280"), F("2"));
+        addTagsSensor(measurement, "bme280", "2");
 
-        measurement.addValue("temperature", bme2_temp());
-        measurement.addValue("pressure", bme2_pressure());
-        measurement.addValue("humidity", bme2_humid());
+        int values = 0;
+        unsigned long acquired = 0;
+        values += addSample(measurement, "temperature", SENSOR_BME2_TEMP, acquired);
+        values += addSample(measurement, "pressure", SENSOR_BME2_PRESSURE, acquired);
+        values += addSample(measurement, "humidity", SENSOR_BME2_HUMID, acquired);
 
-        debug.println(F("Writing bme2"));
-        writeMeasurement(measurement);
-        debug.println(F("Done!"));
+        if (values > 0) {
+            debug.println(F("Adding bme2"));
+            addMeasurement(measurement, acquired);
+        }
     }
 
 #endif // ENABLE_BME280
 
     if (found_sht) {
         InfluxData measurement("environment");
-        addTagsSensor(measurement, F("sht21"), F("1"));
+        addTagsSensor(measurement, "sht21", "1");
 
-        measurement.addValue("temperature", sht_temp());
-        measurement.addValue("humidity", sht_humid());
+        int values = 0;
+        unsigned long acquired = 0;
+        values += addSample(measurement, "temperature", SENSOR_SHT_TEMP, acquired);
+        values += addSample(measurement, "humidity", SENSOR_SHT_HUMID, acquired);
 
-        debug.println(F("Writing sht"));
-        writeMeasurement(measurement);
-        debug.println(F("Done!"));
+        if (values > 0) {
+            debug.println(F("Adding sht"));
+            addMeasurement(measurement, acquired);
+        }
     }
 
 #ifdef ENABLE_CCS811
 
     if (found_ccs1) {
         InfluxData measurement("environment");
-        addTagsSensor(measurement, F("ccs811"), F("1"));
+        addTagsSensor(measurement, "ccs811", "1");
 
-        String err(ccs1_error_code);
+        char err[8];
+        itoa(ccs1_error_code, err, 10);
         measurement.addTag("error", err);
 
-        measurement.addValue("eco2", ccs1_eco2());
-        measurement.addValue("tvoc", ccs1_tvoc());
+        int values = 0;
+        unsigned long acquired = 0;
+        values += addSample(measurement, "eco2", SENSOR_CCS1_ECO2, acquired);
+        values += addSample(measurement, "tvoc", SENSOR_CCS1_TVOC, acquired);
 
-        debug.println(F("Writing ccs1"));
-        writeMeasurement(measurement);
-        debug.println(F("Done!"));
+        if (values > 0) {
+            debug.println(F("Adding ccs1"));
+            addMeasurement(measurement, acquired);
+        }
     }
 
     if (found_ccs2) {
         InfluxData measurement("environment");
-        addTagsSensor(measurement, F("ccs811"), F("2"));
+        addTagsSensor(measurement, "ccs811", "2");
 
-        String err(ccs2_error_code);
+        char err[8];
+        itoa(ccs2_error_code, err, 10);
         measurement.addTag("error", err);
 
-        measurement.addValue("eco2", ccs2_eco2());
-        measurement.addValue("tvoc", ccs2_tvoc());
+        int values = 0;
+        unsigned long acquired = 0;
+        values += addSample(measurement, "eco2", SENSOR_CCS2_ECO2, acquired);
+        values += addSample(measurement, "tvoc", SENSOR_CCS2_TVOC, acquired);
 
-        debug.println(F("Writing ccs2"));
-        writeMeasurement(measurement);
-        debug.println(F("Done!"));
+        if (values > 0) {
+            debug.println(F("Adding ccs2"));
+            addMeasurement(measurement, acquired);
+        }
     }
 
 #endif // ENABLE_CCS811
@@ -222,34 +515,37 @@ void writeDatabase() {
     for (int i = 0; i < moisture_count(); i++) {
         int moisture = moisture_read(i);
         if (moisture < moisture_max()) {
-            String sensor(i + 1, DEC);
+            char sensor[8];
+            itoa(i + 1, sensor, 10);
             InfluxData measurement("moisture");
             addTagsSensor(measurement, sensor, sensor);
 
             measurement.addValue("value", moisture);
             measurement.addValue("maximum", moisture_max());
 
-            debug.print(F("Writing moisture "));
+            debug.print(F("Adding moisture "));
             debug.println(i);
-            writeMeasurement(measurement);
-            debug.println(F("Done!"));
+            addMeasurement(measurement, millis());
         }
     }
 #endif // FEATURE_MOISTURE
 
 #ifdef FEATURE_RELAIS
     for (int i = 0; i < relais_count(); i++) {
+        char id[8];
+        itoa(i, id, 10);
         InfluxData measurement("relais");
-        addTagsRelais(measurement, String(i), relais_name(i));
+        addTagsRelais(measurement, id, relais_name(i));
 
         measurement.addValue("state", relais_get(i));
 
-        debug.print(F("Writing relais "));
+        debug.print(F("Adding relais "));
         debug.println(i);
-        writeMeasurement(measurement);
-        debug.println(F("Done!"));
+        addMeasurement(measurement, millis());
     }
 #endif // FEATURE_RELAIS
+
+    flushMeasurements();
 }
 
 #else
@@ -257,5 +553,7 @@ void writeDatabase() {
 void initInflux() { }
 void runInflux() { }
 void writeDatabase() { }
+void requestDatabaseWrite() { }
+String influxStatus() { return String(); }
 
 #endif // ENABLE_INFLUXDB_LOGGING
@@ -0,0 +1,118 @@
+/*
+ * led.cpp
+ *
+ * ESP8266 / ESP32 Environmental Sensor
+ *
+ * Blinks the built-in LED in table driven patterns without blocking.
+ * The scheduler job is only woken up for the next edge of the LED.
+ *
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "scheduler.h"
+#include "led.h"
+
+struct led_pattern_def {
+    unsigned long on, off; // in ms
+    int repeat; // 0 for endless
+};
+
+static const struct led_pattern_def patterns[LED_PATTERN_COUNT] = {
+    { 0, 0, 0 }, // LED_PATTERN_OFF
+    { LED_BLINK_INTERVAL, LED_BLINK_INTERVAL, 0 }, // LED_PATTERN_HEARTBEAT
+    { LED_CONNECT_BLINK_INTERVAL, LED_CONNECT_BLINK_INTERVAL, 0 }, // LED_PATTERN_CONNECTING
+    { LED_INIT_BLINK_INTERVAL, LED_INIT_BLINK_INTERVAL, 2 }, // LED_PATTERN_INIT
+    { LED_ERROR_BLINK_INTERVAL, LED_ERROR_BLINK_INTERVAL, 10 }, // LED_PATTERN_ERROR
+};
+
+static int led_job = -1;
+
+// requests from led_set(), -1 if none
+static volatile int next_base = -1;
+static volatile int next_once = -1;
+
+static enum led_pattern base = LED_PATTERN_OFF;
+static enum led_pattern current = LED_PATTERN_OFF;
+static int step = 0; // on and off phases done in current pattern
+static unsigned long step_deadline = 0;
+
+static void led_write(bool on) {
+    digitalWrite(BUILTIN_LED_PIN, on ? LOW : HIGH); // active low
+}
+
+static bool led_active(void) {
+    return patterns[current].on > 0;
+}
+
+static void led_start(enum led_pattern pattern, unsigned long now) {
+    current = pattern;
+    step = 0;
+    step_deadline = now + patterns[current].on;
+    led_write(led_active());
+}
+
+void led_init(void) {
+    pinMode(BUILTIN_LED_PIN, OUTPUT);
+    led_write(false);
+
+    led_job = sched_add("led", led_run, 0);
+}
+
+void led_set(enum led_pattern pattern) {
+    if (patterns[pattern].repeat > 0) {
+        next_once = pattern;
+    } else {
+        next_base = pattern;
+    }
+
+    sched_trigger(led_job);
+}
+
+void led_run(void) {
+    unsigned long now = millis();
+
+    if (next_base >= 0) {
+        base = (enum led_pattern)next_base;
+        next_base = -1;
+
+        // let a running one-shot pattern finish first
+        if (patterns[current].repeat == 0) {
+            led_start(base, now);
+        }
+    }
+
+    if (next_once >= 0) {
+        led_start((enum led_pattern)next_once, now);
+        next_once = -1;
+    }
+
+    if (!led_active()) {
+        return;
+    }
+
+    if ((long)(now - step_deadline) >= 0) {
+        const struct led_pattern_def *p = &patterns[current];
+        step++;
+
+        if ((p->repeat > 0) && (step >= (2 * p->repeat))) {
+            led_start(base, now);
+            if (!led_active()) {
+                return;
+            }
+        } else {
+            bool on = !(step & 1);
+            led_write(on);
+            step_deadline = now + (on ? p->on : p->off);
+        }
+    }
+
+    sched_trigger_in(led_job, step_deadline - now);
+}
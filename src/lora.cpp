@@ -27,6 +27,7 @@
 #include "DebugLog.h"
 #include "influx.h"
 #include "smart_meter.h"
+#include "scheduler.h"
 #include "lora.h"
 
 //#define DEBUG_LORA_RX_HEXDUMP
@@ -287,6 +288,9 @@ void lora_sml_done(void) {
 #endif // FEATURE_SML
 
 void lora_init(void) {
+    // needs to run even without working radio, for sleep and button handling
+    sched_add("lora", lora_run, LORA_HANDLE_INTERVAL);
+
 #ifdef FEATURE_SML
     for (int i = 0; i < LORA_SML_NUM_MESSAGES; i++) {
         cache[i].value = NAN;
@@ -444,7 +448,7 @@ void lora_run(void) {
                 } else {
                     debug.printf("  Value: %.2f\n", msg->value);
 
-                    String key;
+                    const char *key;
                     switch (data[0]) {
                         case LORA_SML_HELLO:
                             key = "hello";
@@ -36,8 +36,8 @@
 #include "ui.h"
 #include "lora.h"
 #include "smart_meter.h"
-
-unsigned long last_led_blink_time = 0;
+#include "scheduler.h"
+#include "led.h"
 
 ConfigMemory config;
 
@@ -56,7 +56,7 @@ void onDisconnected(const WiFiEventStationModeDisconnected& event) {
 #endif // ARDUINO_ARCH_ESP8266
 
 void setup() {
-    pinMode(BUILTIN_LED_PIN, OUTPUT);
+    led_init();
 
     Serial.begin(115200);
 
@@ -67,14 +67,8 @@ void setup() {
     debug.println(F("Initializing..."));
 
 #ifndef FEATURE_LORA
-    // Blink LED for init
-    for (int i = 0; i < 2; i++) {
-        digitalWrite(BUILTIN_LED_PIN, LOW); // LED on
-        delay(LED_INIT_BLINK_INTERVAL);
-        digitalWrite(BUILTIN_LED_PIN, HIGH); // LED off
-        delay(LED_INIT_BLINK_INTERVAL);
-    }
-#endif // ! FEATURE_SML
+    led_set(LED_PATTERN_INIT);
+#endif // ! FEATURE_LORA
 
 #ifdef FEATURE_UI
     debug.println(F("UI"));
@@ -129,9 +123,10 @@ void setup() {
     WiFi.mode(WIFI_STA);
     WiFi.hostname(hostname);
     WiFi.begin(WIFI_SSID, WIFI_PASS);
+    led_set(LED_PATTERN_CONNECTING);
     while (WiFi.status() != WL_CONNECTED) {
         delay(LED_CONNECT_BLINK_INTERVAL);
-        digitalWrite(BUILTIN_LED_PIN, !digitalRead(BUILTIN_LED_PIN));
+        led_run();
         debug.print(F("."));
 #ifdef FEATURE_UI
         ui_progress(UI_WIFI_CONNECTING);
@@ -187,9 +182,10 @@ void setup() {
     WiFi.mode(WIFI_STA);
     WiFi.setHostname(hostname.c_str());
     WiFi.begin(WIFI_SSID, WIFI_PASS);
+    led_set(LED_PATTERN_CONNECTING);
     while (WiFi.status() != WL_CONNECTED) {
         delay(LED_CONNECT_BLINK_INTERVAL);
-        digitalWrite(BUILTIN_LED_PIN, !digitalRead(BUILTIN_LED_PIN));
+        led_run();
         debug.print(F("."));
 #ifdef FEATURE_UI
         ui_progress(UI_WIFI_CONNECTING);
@@ -218,9 +214,10 @@ void setup() {
     ui_progress(UI_WIFI_CONNECT);
 #endif // FEATURE_UI
     WiFi.begin(WIFI_SSID, WIFI_PASS);
+    led_set(LED_PATTERN_CONNECTING);
     while (WiFi.status() != WL_CONNECTED) {
         delay(LED_CONNECT_BLINK_INTERVAL);
-        digitalWrite(BUILTIN_LED_PIN, !digitalRead(BUILTIN_LED_PIN));
+        led_run();
         debug.print(F("."));
 #ifdef FEATURE_UI
         ui_progress(UI_WIFI_CONNECTING);
@@ -238,6 +235,9 @@ void setup() {
     configTime(0, 0, NTP_SERVER);
     setenv("TZ", NTP_TZ_LOCATION, 1);
     tzset();
+#elif defined(ENABLE_INFLUXDB_LOGGING) && !defined(ARDUINO_ARCH_AVR)
+    // clock for the timestamps of Influx points
+    configTime(0, 0, NTP_SERVER);
 #endif
 
     debug.println(F("Seeding"));
@@ -254,6 +254,12 @@ void setup() {
 
 #endif // FEATURE_DISABLE_WIFI
 
+#ifndef FEATURE_LORA
+    led_set(LED_PATTERN_HEARTBEAT);
+#else
+    led_set(LED_PATTERN_OFF);
+#endif // ! FEATURE_LORA
+
     debug.println(F("Ready! Starting..."));
 
 #ifdef FEATURE_UI
@@ -267,34 +273,5 @@ void loop() {
     esp_task_wdt_reset();
 #endif // ARDUINO_ARCH_ESP32
 
-#ifndef DISABLE_SENSORS
-    runSensors();
-#endif // ! DISABLE_SENSORS
-
-#ifdef FEATURE_SML
-    sml_run();
-#endif // FEATURE_SML
-
-#ifndef FEATURE_DISABLE_WIFI
-    runServers();
-    runMQTT();
-    runInflux();
-#endif // FEATURE_DISABLE_WIFI
-
-#ifdef FEATURE_UI
-    ui_run();
-#endif
-
-#ifdef FEATURE_LORA
-    lora_run();
-#endif // FEATURE_LORA
-
-#ifndef FEATURE_LORA
-    // blink heartbeat LED
-    unsigned long time = millis();
-    if ((time - last_led_blink_time) >= LED_BLINK_INTERVAL) {
-        last_led_blink_time = time;
-        digitalWrite(BUILTIN_LED_PIN, !digitalRead(BUILTIN_LED_PIN));
-    }
-#endif // ! FEATURE_LORA
+    sched_run();
 }
@@ -19,6 +19,7 @@
 #include "relais.h"
 #include "influx.h"
 #include "ui.h"
+#include "scheduler.h"
 #include "mqtt.h"
 
 #ifdef ENABLE_MQTT
@@ -44,15 +45,196 @@
 
 #include <PubSubClient.h>
 
-WiFiClient mqttClient;
+/*
+ * PubSubClient does not tell if the broker still had our session, so
+ * the CONNACK is looked at on its way through. It is the first packet
+ * after CONNECT, its third byte has the session present flag.
+ */
+class MQTTSessionClient : public WiFiClient {
+public:
+    using WiFiClient::read;
+
+    void expectConnAck() { connack_len = 0; }
+    bool sessionPresent() {
+        return (connack_len >= 3) && (connack[0] == 0x20) && (connack[2] & 0x01);
+    }
+
+    virtual int read() {
+        int c = WiFiClient::read();
+        if ((c >= 0) && (connack_len < sizeof(connack))) {
+            connack[connack_len++] = c;
+        }
+        return c;
+    }
+
+private:
+    uint8_t connack[4];
+    size_t connack_len = sizeof(connack);
+};
+
+MQTTSessionClient mqttClient;
 PubSubClient mqtt(mqttClient);
-static unsigned long last_mqtt_reconnect_time = 0;
-static unsigned long last_mqtt_write_time = 0;
 
 #ifdef FEATURE_UI
 static struct ui_status prev_status = ui_status;
+
+enum mqtt_value_type {
+    MQTT_BOOL = 0, // "on" / "off"
+    MQTT_BOOL_UPPER, // "ON" / "OFF"
+    MQTT_FLOAT,
+    MQTT_BATH_LIGHT,
+};
+
+struct mqtt_topic {
+    const char *topic;
+    enum mqtt_value_type type;
+    size_t offset; // of the field in struct ui_status
+    bool publish; // send local changes in writeMQTT_UI()
+};
+
+/*
+ * All topics shown in the UI. Drives the subscriptions, the callback
+ * and writeMQTT_UI(). Needs to stay sorted by topic for mqttFindTopic(),
+ * initMQTT() complains otherwise.
+ */
+static const struct mqtt_topic mqtt_topics[] = {
+    { "bathroom/fan", MQTT_BOOL, UI_FIELD(bathroom_fan), false },
+    { "bathroom/force_light", MQTT_BATH_LIGHT, UI_FIELD(bathroom_lights), true },
+    { "bathroom/humidity", MQTT_FLOAT, UI_FIELD(bathroom_humidity), false },
+    { "bathroom/temperature", MQTT_FLOAT, UI_FIELD(bathroom_temperature), false },
+    { "bedroom/heated_blanket/cmnd/POWER", MQTT_BOOL, UI_FIELD(bedroom_blanket), true },
+    { "bedroom/humidity", MQTT_FLOAT, UI_FIELD(bedroom_humidity), false },
+    { "bedroom/nightstand1_light/cmnd/POWER", MQTT_BOOL, UI_FIELD(light_nightstand1), true },
+    { "bedroom/temperature", MQTT_FLOAT, UI_FIELD(bedroom_temperature), false },
+    { "livingroom/amp/cmnd/POWER", MQTT_BOOL, UI_FIELD(sound_amplifier), true },
+    { "livingroom/displays/cmnd/POWER", MQTT_BOOL, UI_FIELD(pc_displays), true },
+    { "livingroom/humidity", MQTT_FLOAT, UI_FIELD(livingroom_humidity), false },
+    { "livingroom/light_amp", MQTT_BOOL, UI_FIELD(light_amp), true },
+    { "livingroom/light_bench", MQTT_BOOL, UI_FIELD(light_bench), true },
+    { "livingroom/light_box", MQTT_BOOL, UI_FIELD(light_box), true },
+    { "livingroom/light_corner/cmnd/POWER", MQTT_BOOL, UI_FIELD(light_corner), true },
+    { "livingroom/light_kitchen", MQTT_BOOL, UI_FIELD(light_kitchen), true },
+    { "livingroom/light_pc", MQTT_BOOL, UI_FIELD(light_pc), true },
+    { "livingroom/light_sink/cmnd/POWER", MQTT_BOOL, UI_FIELD(light_sink), true },
+    { "livingroom/temperature", MQTT_FLOAT, UI_FIELD(livingroom_temperature), false },
+    { "livingroom/workbench/cmnd/POWER", MQTT_BOOL, UI_FIELD(light_workspace), true },
+    { "wled/pc", MQTT_BOOL_UPPER, UI_FIELD(led_strip_pc), true },
+    // TODO bathroom/force_fan
+};
+
+#define MQTT_TOPIC_COUNT (sizeof(mqtt_topics) / sizeof(mqtt_topics[0]))
+
+/*
+ * subscriptions covering all of mqtt_topics, the callback filters again.
+ * Only the topic shapes used above, so the Tasmota tele / stat topics of
+ * the devices in these rooms stay away.
+ */
+static const char *mqtt_filters[] = {
+    "bathroom/+",
+    "bedroom/+",
+    "bedroom/+/cmnd/POWER",
+    "livingroom/+",
+    "livingroom/+/cmnd/POWER",
+    "wled/pc",
+};
+
+#define MQTT_FILTER_COUNT (sizeof(mqtt_filters) / sizeof(mqtt_filters[0]))
+
+static bool mqttFilterMatches(const char *filter, const char *topic) {
+    while (*filter) {
+        if (*filter == '#') {
+            return true;
+        } else if (*filter == '+') {
+            while (*topic && (*topic != '/')) {
+                topic++;
+            }
+            filter++;
+        } else if (*filter == *topic) {
+            filter++;
+            topic++;
+        } else {
+            return false;
+        }
+    }
+    return *topic == '\0';
+}
+
+static const struct mqtt_topic *mqttFindTopic(const char *topic) {
+    int lo = 0, hi = MQTT_TOPIC_COUNT - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        int c = strcmp(topic, mqtt_topics[mid].topic);
+        if (c == 0) {
+            return &mqtt_topics[mid];
+        } else if (c < 0) {
+            hi = mid - 1;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return NULL;
+}
+
+static void *mqttField(struct ui_status *status, const struct mqtt_topic *t) {
+    return (uint8_t *)status + t->offset;
+}
 #endif // FEATURE_UI
 
+enum mqtt_sensor_topics {
+    MQTT_SENSOR_TEMPERATURE = 0,
+    MQTT_SENSOR_HUMIDITY,
+    MQTT_SENSOR_PRESSURE,
+    MQTT_SENSOR_ECO2,
+    MQTT_SENSOR_TVOC,
+
+    MQTT_SENSOR_COUNT
+};
+
+struct mqtt_sensor_topic {
+    const char *topic;
+    float deadband;
+
+    bool published;
+    float value; // last published
+    unsigned long time; // millis() of last publish
+};
+
+static struct mqtt_sensor_topic sensor_topics[MQTT_SENSOR_COUNT] = {
+    { SENSOR_LOCATION "/temperature", MQTT_DEADBAND_TEMPERATURE, false, 0.0f, 0 },
+    { SENSOR_LOCATION "/humidity", MQTT_DEADBAND_HUMIDITY, false, 0.0f, 0 },
+    { SENSOR_LOCATION "/pressure", MQTT_DEADBAND_PRESSURE, false, 0.0f, 0 },
+    { SENSOR_LOCATION "/eco2", MQTT_DEADBAND_ECO2, false, 0.0f, 0 },
+    { SENSOR_LOCATION "/tvoc", MQTT_DEADBAND_TVOC, false, 0.0f, 0 },
+};
+
+/*
+ * publishes a cached sensor sample, if it is valid and has moved more
+ * than the deadband, or has not been published for MQTT_MAX_SILENCE.
+ */
+static bool publishSample(enum mqtt_sensor_topics topic, enum sensor_channels channel) {
+    const struct sensor_sample *s = sensor_get(channel);
+    if (!s->valid) {
+        return false;
+    }
+
+    struct mqtt_sensor_topic *t = &sensor_topics[topic];
+    unsigned long now = millis();
+    bool changed = (!t->published) || (fabs(s->value - t->value) > t->deadband);
+    bool silent = (now - t->time) >= MQTT_MAX_SILENCE;
+    if ((!changed) && (!silent)) {
+        return false;
+    }
+
+    if (!mqtt.publish(t->topic, String(s->value).c_str(), true)) {
+        return false;
+    }
+
+    t->published = true;
+    t->value = s->value;
+    t->time = now;
+    return true;
+}
+
 static void writeMQTT() {
     if (!mqtt.connected()) {
         return;
@@ -60,33 +242,28 @@ static void writeMQTT() {
 
     bool wrote = false;
 
-    if (found_sht) {
-        mqtt.publish(SENSOR_LOCATION "/temperature", String(sht_temp()).c_str(), true);
-        mqtt.publish(SENSOR_LOCATION "/humidity", String(sht_humid()).c_str(), true);
-        wrote = true;
+    if (found_sht && sensor_get(SENSOR_SHT_TEMP)->valid) {
+        wrote |= publishSample(MQTT_SENSOR_TEMPERATURE, SENSOR_SHT_TEMP);
+        wrote |= publishSample(MQTT_SENSOR_HUMIDITY, SENSOR_SHT_HUMID);
 #ifdef ENABLE_BME280
-    } else if (found_bme1) {
-        mqtt.publish(SENSOR_LOCATION "/temperature", String(bme1_temp()).c_str(), true);
-        mqtt.publish(SENSOR_LOCATION "/humidity", String(bme1_humid()).c_str(), true);
-        mqtt.publish(SENSOR_LOCATION "/pressure", String(bme1_pressure()).c_str(), true);
-        wrote = true;
-    } else if (found_bme2) {
-        mqtt.publish(SENSOR_LOCATION "/temperature", String(bme2_temp()).c_str(), true);
-        mqtt.publish(SENSOR_LOCATION "/humidity", String(bme2_humid()).c_str(), true);
-        mqtt.publish(SENSOR_LOCATION "/pressure", String(bme2_pressure()).c_str(), true);
-        wrote = true;
+    } else if (found_bme1 && sensor_get(SENSOR_BME1_TEMP)->valid) {
+        wrote |= publishSample(MQTT_SENSOR_TEMPERATURE, SENSOR_BME1_TEMP);
+        wrote |= publishSample(MQTT_SENSOR_HUMIDITY, SENSOR_BME1_HUMID);
+        wrote |= publishSample(MQTT_SENSOR_PRESSURE, SENSOR_BME1_PRESSURE);
+    } else if (found_bme2 && sensor_get(SENSOR_BME2_TEMP)->valid) {
+        wrote |= publishSample(MQTT_SENSOR_TEMPERATURE, SENSOR_BME2_TEMP);
+        wrote |= publishSample(MQTT_SENSOR_HUMIDITY, SENSOR_BME2_HUMID);
+        wrote |= publishSample(MQTT_SENSOR_PRESSURE, SENSOR_BME2_PRESSURE);
 #endif // ENABLE_BME280
     }
 
 #ifdef ENABLE_CCS811
-    if (found_ccs1) {
-        mqtt.publish(SENSOR_LOCATION "/eco2", String(ccs1_eco2()).c_str(), true);
-        mqtt.publish(SENSOR_LOCATION "/tvoc", String(ccs1_tvoc()).c_str(), true);
-        wrote = true;
-    } else if (found_ccs2) {
-        mqtt.publish(SENSOR_LOCATION "/eco2", String(ccs2_eco2()).c_str(), true);
-        mqtt.publish(SENSOR_LOCATION "/tvoc", String(ccs2_tvoc()).c_str(), true);
-        wrote = true;
+    if (found_ccs1 && sensor_get(SENSOR_CCS1_ECO2)->valid) {
+        wrote |= publishSample(MQTT_SENSOR_ECO2, SENSOR_CCS1_ECO2);
+        wrote |= publishSample(MQTT_SENSOR_TVOC, SENSOR_CCS1_TVOC);
+    } else if (found_ccs2 && sensor_get(SENSOR_CCS2_ECO2)->valid) {
+        wrote |= publishSample(MQTT_SENSOR_ECO2, SENSOR_CCS2_ECO2);
+        wrote |= publishSample(MQTT_SENSOR_TVOC, SENSOR_CCS2_TVOC);
     }
 #endif // ENABLE_CCS811
 
@@ -95,284 +272,455 @@ static void writeMQTT() {
     }
 }
 
-static void mqttCallback(char* topic, byte* payload, unsigned int length) {
-    String ts(topic), ps;
+#define MQTT_PAYLOAD_MAX_TOKEN 24
+
+enum mqtt_payload_state {
+    MQTT_STATE_UNKNOWN = -1,
+    MQTT_STATE_OFF = 0,
+    MQTT_STATE_ON,
+    MQTT_STATE_SMALL,
+    MQTT_STATE_BIG,
+    MQTT_STATE_NONE,
+    MQTT_STATE_BOTH,
+};
+
+struct mqtt_payload {
+    enum mqtt_payload_state state;
+    float number; // NAN if the payload is no number
+};
+
+static const struct {
+    const char *token;
+    enum mqtt_payload_state state;
+} mqtt_tokens[] = {
+    { "on", MQTT_STATE_ON },
+    { "off", MQTT_STATE_OFF },
+    { "small", MQTT_STATE_SMALL },
+    { "big", MQTT_STATE_BIG },
+    { "none", MQTT_STATE_NONE },
+    { "both", MQTT_STATE_BOTH },
+};
+
+// parse the payload in place, without any heap allocation
+static void mqttParse(const byte *payload, unsigned int length, struct mqtt_payload *p) {
+    p->state = MQTT_STATE_UNKNOWN;
+    p->number = NAN;
+
+    while ((length > 0) && isspace(payload[0])) {
+        payload++;
+        length--;
+    }
+    while ((length > 0) && isspace(payload[length - 1])) {
+        length--;
+    }
+
+    if ((length == 0) || (length >= MQTT_PAYLOAD_MAX_TOKEN)) {
+        return;
+    }
+
+    // lower case copy, terminated for strtod()
+    char token[MQTT_PAYLOAD_MAX_TOKEN];
     for (unsigned int i = 0; i < length; i++) {
-        char c = payload[i];
-        ps += c;
+        token[i] = tolower(payload[i]);
     }
+    token[length] = '\0';
 
-    debug.print(F("MQTT &lt;Rx  @ \""));
-    debug.print(ts);
-    debug.print(F("\" = \""));
-    debug.print(ps);
-    debug.println(F("\""));
+    for (unsigned int i = 0; i < (sizeof(mqtt_tokens) / sizeof(mqtt_tokens[0])); i++) {
+        if (strcmp(token, mqtt_tokens[i].token) == 0) {
+            p->state = mqtt_tokens[i].state;
+            return;
+        }
+    }
 
-#if defined(FEATURE_RELAIS) || defined(FEATURE_UI)
-    int state = 0;
-    if (ps.indexOf("on") != -1) {
-        state = 1;
-    } else if (ps.indexOf("ON") != -1) {
-        state = 1;
-    } else if (ps.indexOf("off") != -1) {
-        state = 0;
-    } else if (ps.indexOf("OFF") != -1) {
-        state = 0;
-    } else if (ps.indexOf("big") != -1) {
-        state = 3;
-    } else if (ps.indexOf("small") != -1) {
-        state = 2;
-    } else if (ps.indexOf("none") != -1) {
-        state = 4;
-    } else if (ps.indexOf("both") != -1) {
-        state = 5;
-    } else {
-        state = -1;
+    char *end = NULL;
+    float f = strtod(token, &end);
+    if ((end != token) && (*end == '\0')) {
+        p->number = f;
+        p->state = (f != 0.0f) ? MQTT_STATE_ON : MQTT_STATE_OFF;
     }
-#endif
+}
+
+static bool mqttPayloadIs(const byte *payload, unsigned int length, const char *s) {
+    return (length == strlen(s)) && (memcmp(payload, s, length) == 0);
+}
 
 #ifdef FEATURE_UI
-    // store new topic values for display
-    if (ts == "livingroom/light_kitchen") {
-        ui_status.light_kitchen = state ? true : false;
-
-        prev_status.light_kitchen = ui_status.light_kitchen;
-        ui_progress(UI_UPDATE);
-    } else if (ts == "livingroom/light_pc") {
-        ui_status.light_pc = state ? true : false;
-
-        prev_status.light_pc = ui_status.light_pc;
-        ui_progress(UI_UPDATE);
-    } else if (ts == "livingroom/light_bench") {
-        ui_status.light_bench = state ? true : false;
-
-        prev_status.light_bench = ui_status.light_bench;
-        ui_progress(UI_UPDATE);
-    } else if (ts == "livingroom/light_amp") {
-        ui_status.light_amp = state ? true : false;
-
-        prev_status.light_amp = ui_status.light_amp;
-        ui_progress(UI_UPDATE);
-    } else if (ts == "livingroom/light_box") {
-        ui_status.light_box = state ? true : false;
-
-        prev_status.light_box = ui_status.light_box;
-        ui_progress(UI_UPDATE);
-    } else if (ts == "livingroom/light_corner/cmnd/POWER") {
-        ui_status.light_corner = state ? true : false;
-
-        prev_status.light_corner = ui_status.light_corner;
-        ui_progress(UI_UPDATE);
-    } else if (ts == "livingroom/workbench/cmnd/POWER") {
-        ui_status.light_workspace = state ? true : false;
-
-        prev_status.light_workspace = ui_status.light_workspace;
-        ui_progress(UI_UPDATE);
-    } else if (ts == "livingroom/amp/cmnd/POWER") {
-        ui_status.sound_amplifier = state ? true : false;
-
-        prev_status.sound_amplifier = ui_status.sound_amplifier;
-        ui_progress(UI_UPDATE);
-    } else if (ts == "livingroom/light_sink/cmnd/POWER") {
-        ui_status.light_sink = state ? true : false;
-
-        prev_status.light_sink = ui_status.light_sink;
-        ui_progress(UI_UPDATE);
-    } else if (ts == "livingroom/displays/cmnd/POWER") {
-        ui_status.pc_displays = state ? true : false;
-
-        prev_status.pc_displays = ui_status.pc_displays;
-        ui_progress(UI_UPDATE);
-    } else if (ts == "bedroom/nightstand1_light/cmnd/POWER") {
-        ui_status.light_nightstand1 = state ? true : false;
-
-        prev_status.light_nightstand1 = ui_status.light_nightstand1;
-        ui_progress(UI_UPDATE);
-    } else if (ts == "bedroom/temperature") {
-        ui_status.bedroom_temperature = ps.toFloat();
-
-        prev_status.bedroom_temperature = ui_status.bedroom_temperature;
-        ui_progress(UI_UPDATE);
-    } else if (ts == "bedroom/humidity") {
-        ui_status.bedroom_humidity = ps.toFloat();
-
-        prev_status.bedroom_humidity = ui_status.bedroom_humidity;
-        ui_progress(UI_UPDATE);
-    } else if (ts == "bathroom/force_light") {
-        if (state == 0) {
-            ui_status.bathroom_lights = BATH_LIGHT_OFF;
-        } else if (state == 1) {
-            ui_status.bathroom_lights = BATH_LIGHT_NONE;
-        } else if (state == 2) {
-            ui_status.bathroom_lights = BATH_LIGHT_SMALL;
-        } else if (state == 3) {
-            ui_status.bathroom_lights = BATH_LIGHT_BIG;
-        } else if (state == 4) {
-            ui_status.bathroom_lights = BATH_LIGHT_NONE;
-        } else if (state == 5) {
-            ui_status.bathroom_lights = BATH_LIGHT_BOTH;
+static void mqttStore(struct ui_status *status, const struct mqtt_topic *t, const struct mqtt_payload *p) {
+    void *field = mqttField(status, t);
+
+    switch (t->type) {
+        case MQTT_BOOL:
+        case MQTT_BOOL_UPPER:
+            if ((p->state == MQTT_STATE_ON) || (p->state == MQTT_STATE_OFF)) {
+                *(bool *)field = (p->state == MQTT_STATE_ON);
+            }
+            break;
+
+        case MQTT_FLOAT:
+            if (!isnan(p->number)) {
+                *(float *)field = p->number;
+            }
+            break;
+
+        case MQTT_BATH_LIGHT: {
+            enum bathroom_light_states *light = (enum bathroom_light_states *)field;
+            switch (p->state) {
+                case MQTT_STATE_OFF:
+                    *light = BATH_LIGHT_OFF;
+                    break;
+                case MQTT_STATE_ON:
+                case MQTT_STATE_NONE:
+                    *light = BATH_LIGHT_NONE;
+                    break;
+                case MQTT_STATE_SMALL:
+                    *light = BATH_LIGHT_SMALL;
+                    break;
+                case MQTT_STATE_BIG:
+                    *light = BATH_LIGHT_BIG;
+                    break;
+                case MQTT_STATE_BOTH:
+                    *light = BATH_LIGHT_BOTH;
+                    break;
+                default:
+                    break;
+            }
+            break;
         }
+    }
+}
+#endif // FEATURE_UI
+
+static bool mqttIsCommand(const char *topic) {
+    return (strcmp(topic, "esp_env/cmd") == 0) || (strcmp(topic, SENSOR_LOCATION "/esp_env/cmd") == 0);
+}
 
-        prev_status.bathroom_lights = ui_status.bathroom_lights;
-        ui_progress(UI_UPDATE);
-    } else if (ts == "bathroom/force_fan") {
-        // TODO
-    } else if (ts == "bathroom/fan") {
-        ui_status.bathroom_fan = state ? true : false;
-
-        prev_status.bathroom_fan = ui_status.bathroom_fan;
-        ui_progress(UI_UPDATE);
-    } else if (ts == "bathroom/temperature") {
-        ui_status.bathroom_temperature = ps.toFloat();
-
-        prev_status.bathroom_temperature = ui_status.bathroom_temperature;
-        ui_progress(UI_UPDATE);
-    } else if (ts == "bathroom/humidity") {
-        ui_status.bathroom_humidity = ps.toFloat();
-
-        prev_status.bathroom_humidity = ui_status.bathroom_humidity;
-        ui_progress(UI_UPDATE);
-    } else if (ts == "bedroom/heated_blanket/cmnd/POWER") {
-        ui_status.bedroom_blanket = state ? true : false;
-
-        prev_status.bedroom_blanket = ui_status.bedroom_blanket;
-        ui_progress(UI_UPDATE);
-    } else if (ts == "livingroom/temperature") {
-        ui_status.livingroom_temperature = ps.toFloat();
-
-        prev_status.livingroom_temperature = ui_status.livingroom_temperature;
-        ui_progress(UI_UPDATE);
-    } else if (ts == "livingroom/humidity") {
-        ui_status.livingroom_humidity = ps.toFloat();
-
-        prev_status.livingroom_humidity = ui_status.livingroom_humidity;
-        ui_progress(UI_UPDATE);
-    } else if (ts == "wled/pc") {
-        ui_status.led_strip_pc = state ? true : false;
-
-        prev_status.led_strip_pc = ui_status.led_strip_pc;
-        ui_progress(UI_UPDATE);
+#ifdef FEATURE_RELAIS
+// relais controlled by this topic, -1 if none
+static int mqttFindRelais(const char *topic) {
+    static const char our_topic[] = SENSOR_LOCATION "/";
+    if (strncmp(topic, our_topic, sizeof(our_topic) - 1) != 0) {
+        return -1;
     }
+
+    const char *name = topic + sizeof(our_topic) - 1;
+    for (int i = 0; i < relais_count(); i++) {
+        if (strcmp(relais_name(i), name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void mqttSetRelais(int id, const char *topic, const struct mqtt_payload *p) {
+    if ((p->state != MQTT_STATE_ON) && (p->state != MQTT_STATE_OFF)) {
+        debug.printf("Invalid relais state for %s\n", topic);
+        return;
+    }
+
+    int state = (p->state == MQTT_STATE_ON) ? 1 : 0;
+    debug.print(F("Turning "));
+    debug.print(state ? "on" : "off");
+    debug.print(F(" relais "));
+    debug.println(id);
+
+    relais_set(id, state);
+
+    requestDatabaseWrite();
+}
+#endif // FEATURE_RELAIS
+
+static void mqttCallback(char* topic, byte* payload, unsigned int length) {
+    bool command = mqttIsCommand(topic);
+    bool wanted = command;
+
+#ifdef FEATURE_RELAIS
+    int relais = mqttFindRelais(topic);
+    wanted = wanted || (relais >= 0);
+#endif // FEATURE_RELAIS
+
+#ifdef FEATURE_UI
+    const struct mqtt_topic *t = mqttFindTopic(topic);
+    wanted = wanted || (t != NULL);
 #endif // FEATURE_UI
 
-    if (ts.endsWith("esp_env/cmd")) {
-        if (ps == "reset") {
+    if (!wanted) {
+        // the wildcard subscriptions also bring topics nobody here uses
+        return;
+    }
+
+    debug.printf("MQTT &lt;Rx  @ \"%s\" = \"%.*s\"\n", topic,
+            (int)((length < 64) ? length : 64), (const char *)payload);
+
+    if (command) {
+        if (mqttPayloadIs(payload, length, "reset")) {
             delay(1000);
             ESP.restart();
         }
+        return;
     }
 
+    struct mqtt_payload p;
+    mqttParse(payload, length, &p);
+
 #ifdef FEATURE_RELAIS
-    int id = -1;
+    if (relais >= 0) {
+        mqttSetRelais(relais, topic, &p);
+    }
+#endif // FEATURE_RELAIS
 
-    String our_topic(SENSOR_LOCATION);
-    our_topic += "/";
+#ifdef FEATURE_UI
+    // store new topic values for display
+    if (t != NULL) {
+        // not a local change, so don't send it back
+        mqttStore(&ui_status, t, &p);
+        mqttStore(&prev_status, t, &p);
 
-    if (!ts.startsWith(our_topic)) {
-        debug.print(F("Unknown MQTT room "));
-        debug.println(ts);
-        return;
+        ui_update_field(t->offset);
     }
+#endif // FEATURE_UI
+}
 
-    String ids = ts.substring(our_topic.length());
+/*
+ * The connection is built up in steps, one per scheduler pass, so other
+ * jobs run in between. Each step is bounded by MQTT_CONNECT_TIMEOUT.
+ * Failed attempts back off exponentially with random jitter, so a
+ * restarting broker is not hit by all devices at the same time.
+ */
+enum mqtt_conn_state {
+    MQTT_DISCONNECTED = 0, // waiting for the backoff to pass
+    MQTT_TCP_CONNECT,
+    MQTT_HANDSHAKE, // MQTT CONNECT / CONNACK and subscriptions
+    MQTT_CONNECTED,
+};
+
+static enum mqtt_conn_state conn_state = MQTT_DISCONNECTED;
+static int conn_job = -1;
+static int write_job = -1;
+static unsigned long conn_start = 0;
+static int conn_failures = 0; // in a row
+
+static unsigned long conn_attempts = 0;
+static unsigned long conn_failed = 0;
+static unsigned long conn_lost = 0;
+static unsigned long conn_latency_last = 0;
+static unsigned long conn_latency_max = 0;
+static unsigned long conn_resumed = 0; // sessions kept by the broker
+
+#ifdef MQTT_PERSISTENT_SESSION
+// the broker queues what we miss while away
+#define MQTT_SUBSCRIBE_QOS 1
+#else
+#define MQTT_SUBSCRIBE_QOS 0
+#endif // MQTT_PERSISTENT_SESSION
+
+static void mqttSubscribe() {
+#ifdef FEATURE_RELAIS
     for (int i = 0; i < relais_count(); i++) {
-        if (ids == relais_name(i)) {
-            id = i;
-            break;
-        }
+        String topic(SENSOR_LOCATION);
+        topic += String("/") + relais_name(i);
+        mqtt.subscribe(topic.c_str(), MQTT_SUBSCRIBE_QOS);
     }
+#endif // FEATURE_RELAIS
 
-    if (id < 0) {
-        debug.print(F("Unknown MQTT topic "));
-        debug.println(ts);
-        return;
+#ifdef FEATURE_UI
+    for (unsigned int i = 0; i < MQTT_FILTER_COUNT; i++) {
+        mqtt.subscribe(mqtt_filters[i], MQTT_SUBSCRIBE_QOS);
     }
+#endif // FEATURE_UI
 
-    if ((id >= 0) && (id < relais_count())) {
-        debug.print(F("Turning "));
-        debug.print(state ? "on" : "off");
-        debug.print(F(" relais "));
-        debug.println(id);
+    mqtt.subscribe("esp_env/cmd", MQTT_SUBSCRIBE_QOS);
+    mqtt.subscribe(SENSOR_LOCATION "/esp_env/cmd", MQTT_SUBSCRIBE_QOS);
+}
 
-        relais_set(id, state);
+// stable over reboots, so the broker finds our persistent session again
+static String mqttClientId() {
+    String id = F("ESP-" SENSOR_ID "-");
+#if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
+    String mac = WiFi.macAddress();
+    mac.replace(":", "");
+    id += mac.substring(6);
+#else
+    id += String(random(0xffff), HEX);
+#endif
+    return id;
+}
 
-        writeDatabase();
+// random delay between half and all of the current backoff step
+static unsigned long mqttBackoff() {
+    unsigned long backoff = MQTT_RECONNECT_MAX;
+    if (conn_failures < 16) {
+        backoff = (unsigned long)MQTT_RECONNECT_INTERVAL << conn_failures;
+        if (backoff > MQTT_RECONNECT_MAX) {
+            backoff = MQTT_RECONNECT_MAX;
+        }
     }
-#endif // FEATURE_RELAIS
+
+    return (backoff / 2) + random((backoff / 2) + 1);
 }
 
-static void mqttReconnect() {
-    // Create a random client ID
-    String clientId = F("ESP-" SENSOR_ID "-");
-    clientId += String(random(0xffff), HEX);
+static void mqttConnectFailed() {
+    mqttClient.stop();
 
-    // Attempt to connect
-#if defined(MQTT_USER) && defined(MQTT_PASS)
-    if (mqtt.connect(clientId.c_str(), MQTT_USER, MQTT_PASS)) {
+    // the first failure waits one MQTT_RECONNECT_INTERVAL step
+    unsigned long retry = mqttBackoff();
+
+    conn_failed++;
+    conn_failures++;
+    conn_state = MQTT_DISCONNECTED;
+
+    debug.printf("MQTT connect failed (%d), retry in %lums\n", mqtt.state(), retry);
+    sched_trigger_in(conn_job, retry);
+}
+
+static void mqttConnection() {
+    switch (conn_state) {
+        case MQTT_DISCONNECTED:
+            conn_attempts++;
+            conn_start = millis();
+            conn_state = MQTT_TCP_CONNECT;
+            sched_trigger(conn_job);
+            break;
+
+        case MQTT_TCP_CONNECT: {
+#if defined(ARDUINO_ARCH_ESP32)
+            bool connected = mqttClient.connect(MQTT_HOST, MQTT_PORT, MQTT_CONNECT_TIMEOUT);
+#elif defined(ARDUINO_ARCH_ESP8266)
+            mqttClient.setTimeout(MQTT_CONNECT_TIMEOUT);
+            bool connected = mqttClient.connect(MQTT_HOST, MQTT_PORT);
 #else
-    if (mqtt.connect(clientId.c_str())) {
+            bool connected = mqttClient.connect(MQTT_HOST, MQTT_PORT);
 #endif
 
-#ifdef FEATURE_RELAIS
-        for (int i = 0; i < relais_count(); i++) {
-            String topic(SENSOR_LOCATION);
-            topic += String("/") + relais_name(i);
-            mqtt.subscribe(topic.c_str());
+            if (!connected) {
+                mqttConnectFailed();
+                break;
+            }
+
+            conn_state = MQTT_HANDSHAKE;
+            sched_trigger(conn_job);
+            break;
         }
-#endif // FEATURE_RELAIS
 
-#ifdef FEATURE_UI
-        // TODO need to list all topics we're interested in?
-        mqtt.subscribe("livingroom/light_kitchen");
-        mqtt.subscribe("livingroom/light_pc");
-        mqtt.subscribe("livingroom/light_bench");
-        mqtt.subscribe("livingroom/light_amp");
-        mqtt.subscribe("livingroom/light_box");
-        mqtt.subscribe("livingroom/light_corner/cmnd/POWER");
-        mqtt.subscribe("livingroom/workbench/cmnd/POWER");
-        mqtt.subscribe("livingroom/amp/cmnd/POWER");
-        mqtt.subscribe("livingroom/light_sink/cmnd/POWER");
-        mqtt.subscribe("livingroom/displays/cmnd/POWER");
-        mqtt.subscribe("livingroom/temperature");
-        mqtt.subscribe("livingroom/humidity");
-        mqtt.subscribe("wled/pc");
-
-        mqtt.subscribe("bedroom/heated_blanket/cmnd/POWER");
-        mqtt.subscribe("bedroom/nightstand1_light/cmnd/POWER");
-        mqtt.subscribe("bedroom/temperature");
-        mqtt.subscribe("bedroom/humidity");
-
-        mqtt.subscribe("bathroom/force_light");
-        //mqtt.subscribe("bathroom/force_fan");
-        mqtt.subscribe("bathroom/fan");
-        mqtt.subscribe("bathroom/temperature");
-        mqtt.subscribe("bathroom/humidity");
-#endif // FEATURE_UI
+        case MQTT_HANDSHAKE: {
+            String clientId = mqttClientId();
 
-        mqtt.subscribe("esp_env/cmd");
-        mqtt.subscribe(SENSOR_LOCATION "/esp_env/cmd");
+#ifdef MQTT_PERSISTENT_SESSION
+            bool clean = false;
+#else
+            bool clean = true;
+#endif // MQTT_PERSISTENT_SESSION
+
+            mqttClient.expectConnAck();
+
+            // PubSubClient re-uses the TCP connection we already built
+#if defined(MQTT_USER) && defined(MQTT_PASS)
+            bool connected = mqtt.connect(clientId.c_str(), MQTT_USER, MQTT_PASS, NULL, 0, false, NULL, clean);
+#else
+            bool connected = mqtt.connect(clientId.c_str(), NULL, NULL, NULL, 0, false, NULL, clean);
+#endif
+
+            if (!connected) {
+                mqttConnectFailed();
+                break;
+            }
+
+            conn_latency_last = millis() - conn_start;
+            if (conn_latency_last > conn_latency_max) {
+                conn_latency_max = conn_latency_last;
+            }
+#ifdef MQTT_PERSISTENT_SESSION
+            /*
+             * The broker still has our subscriptions, and subscribing again
+             * would make it replay all retained messages. Only when it lost
+             * the session, eg. restarted without persistence, we need them.
+             */
+            if (mqttClient.sessionPresent()) {
+                conn_resumed++;
+            } else {
+                mqttSubscribe();
+            }
+#else
+            mqttSubscribe();
+#endif // MQTT_PERSISTENT_SESSION
+
+            conn_failures = 0;
+            conn_state = MQTT_CONNECTED;
+            break;
+        }
+
+        case MQTT_CONNECTED:
+            break;
     }
 }
 
+String mqttStatus() {
+    String s;
+    s += F("State: ");
+    s += (conn_state == MQTT_CONNECTED) ? F("connected") : F("disconnected");
+    s += F(", Attempts: ");
+    s += String(conn_attempts);
+    s += F(", Failed: ");
+    s += String(conn_failed);
+    s += F(", Lost: ");
+    s += String(conn_lost);
+    s += F(", Resumed: ");
+    s += String(conn_resumed);
+    s += F("<br>Connect time last / max: ");
+    s += String(conn_latency_last);
+    s += F(" / ");
+    s += String(conn_latency_max);
+    s += F("ms");
+    return s;
+}
+
 void initMQTT() {
     mqtt.setServer(MQTT_HOST, MQTT_PORT);
     mqtt.setCallback(mqttCallback);
-}
 
-void runMQTT() {
-    unsigned long time = millis();
+    // in s, bounds the wait for CONNACK
+    mqtt.setSocketTimeout((MQTT_CONNECT_TIMEOUT + 999) / 1000);
 
-    if ((time - last_mqtt_write_time) >= MQTT_WRITE_INTERVAL) {
-        last_mqtt_write_time = time;
-        writeMQTT();
+#ifdef FEATURE_UI
+    for (unsigned int i = 0; i < MQTT_TOPIC_COUNT; i++) {
+        if ((i > 0) && (strcmp(mqtt_topics[i - 1].topic, mqtt_topics[i].topic) >= 0)) {
+            debug.printf("MQTT topic %s not sorted\n", mqtt_topics[i].topic);
+        }
+
+        bool covered = false;
+        for (unsigned int f = 0; f < MQTT_FILTER_COUNT; f++) {
+            covered |= mqttFilterMatches(mqtt_filters[f], mqtt_topics[i].topic);
+        }
+        if (!covered) {
+            debug.printf("MQTT topic %s not subscribed\n", mqtt_topics[i].topic);
+        }
     }
+#endif // FEATURE_UI
+
+    sched_add("mqtt", runMQTT, MQTT_HANDLE_INTERVAL);
+    write_job = sched_add("mqtt-write", writeMQTT, MQTT_WRITE_INTERVAL);
+
+    // try to connect right away
+    conn_job = sched_add("mqtt-conn", mqttConnection, 0);
+    sched_trigger(conn_job);
+}
+
+// publish changed samples right away, the timer is only the heartbeat
+void requestMQTTWrite() {
+    sched_trigger(write_job);
+}
 
-    if (!mqtt.connected() && ((millis() - last_mqtt_reconnect_time) >= MQTT_RECONNECT_INTERVAL)) {
-        last_mqtt_reconnect_time = millis();
-        mqttReconnect();
+void runMQTT() {
+    if (conn_state != MQTT_CONNECTED) {
+        return;
     }
 
-    mqtt.loop();
+    if (!mqtt.loop()) {
+        // spread the reconnects of all devices after a broker restart
+        debug.println(F("MQTT connection lost"));
+        conn_lost++;
+        conn_state = MQTT_DISCONNECTED;
+        sched_trigger_in(conn_job, random(MQTT_RECONNECT_INTERVAL));
+    }
 }
 
 #ifdef FEATURE_UI
@@ -386,60 +734,48 @@ static void mqttPublish(const char* ts, const char *ps, bool retained) {
     mqtt.publish(ts, ps, retained);
 }
 
+static const char *bathLightPayload(enum bathroom_light_states state) {
+    switch (state) {
+        case BATH_LIGHT_BIG:
+            return "big";
+        case BATH_LIGHT_SMALL:
+            return "small";
+        case BATH_LIGHT_BOTH:
+            return "both";
+        case BATH_LIGHT_OFF:
+            return "off";
+        default:
+            return "none";
+    }
+}
+
 void writeMQTT_UI(void) {
     struct ui_status curr_status = ui_status;
 
-    if (curr_status.light_amp != prev_status.light_amp) {
-        mqttPublish("livingroom/light_amp", curr_status.light_amp ? "on" : "off", true);
-    }
-    if (curr_status.light_bench != prev_status.light_bench) {
-        mqttPublish("livingroom/light_bench", curr_status.light_bench ? "on" : "off", true);
-    }
-    if (curr_status.light_box != prev_status.light_box) {
-        mqttPublish("livingroom/light_box", curr_status.light_box ? "on" : "off", true);
-    }
-    if (curr_status.light_corner != prev_status.light_corner) {
-        mqttPublish("livingroom/light_corner/cmnd/POWER", curr_status.light_corner ? "on" : "off", true);
-    }
-    if (curr_status.light_kitchen != prev_status.light_kitchen) {
-        mqttPublish("livingroom/light_kitchen", curr_status.light_kitchen ? "on" : "off", true);
-    }
-    if (curr_status.light_pc != prev_status.light_pc) {
-        mqttPublish("livingroom/light_pc", curr_status.light_pc ? "on" : "off", true);
-    }
-    if (curr_status.light_workspace != prev_status.light_workspace) {
-        mqttPublish("livingroom/workbench/cmnd/POWER", curr_status.light_workspace ? "on" : "off", true);
-    }
-    if (curr_status.sound_amplifier != prev_status.sound_amplifier) {
-        mqttPublish("livingroom/amp/cmnd/POWER", curr_status.sound_amplifier ? "on" : "off", true);
-    }
-    if (curr_status.bathroom_lights != prev_status.bathroom_lights) {
-        if (curr_status.bathroom_lights == BATH_LIGHT_BIG) {
-            mqttPublish("bathroom/force_light", "big", true);
-        } else if (curr_status.bathroom_lights == BATH_LIGHT_SMALL) {
-            mqttPublish("bathroom/force_light", "small", true);
-        } else if (curr_status.bathroom_lights == BATH_LIGHT_BOTH) {
-            mqttPublish("bathroom/force_light", "both", true);
-        } else if (curr_status.bathroom_lights == BATH_LIGHT_OFF) {
-            mqttPublish("bathroom/force_light", "off", true);
-        } else {
-            mqttPublish("bathroom/force_light", "none", true);
+    for (unsigned int i = 0; i < MQTT_TOPIC_COUNT; i++) {
+        const struct mqtt_topic *t = &mqtt_topics[i];
+        if (!t->publish) {
+            continue;
+        }
+
+        void *curr = mqttField(&curr_status, t);
+        void *prev = mqttField(&prev_status, t);
+
+        if (t->type == MQTT_BATH_LIGHT) {
+            enum bathroom_light_states state = *(enum bathroom_light_states *)curr;
+            if (state != *(enum bathroom_light_states *)prev) {
+                mqttPublish(t->topic, bathLightPayload(state), true);
+            }
+        } else if ((t->type == MQTT_BOOL) || (t->type == MQTT_BOOL_UPPER)) {
+            bool state = *(bool *)curr;
+            if (state != *(bool *)prev) {
+                if (t->type == MQTT_BOOL_UPPER) {
+                    mqttPublish(t->topic, state ? "ON" : "OFF", true);
+                } else {
+                    mqttPublish(t->topic, state ? "on" : "off", true);
+                }
+            }
         }
-    }
-    if (curr_status.light_sink != prev_status.light_sink) {
-        mqttPublish("livingroom/light_sink/cmnd/POWER", curr_status.light_sink ? "on" : "off", true);
-    }
-    if (curr_status.pc_displays != prev_status.pc_displays) {
-        mqttPublish("livingroom/displays/cmnd/POWER", curr_status.pc_displays ? "on" : "off", true);
-    }
-    if (curr_status.light_nightstand1 != prev_status.light_nightstand1) {
-        mqttPublish("bedroom/nightstand1_light/cmnd/POWER", curr_status.light_nightstand1 ? "on" : "off", true);
-    }
-    if (curr_status.bedroom_blanket != prev_status.bedroom_blanket) {
-        mqttPublish("bedroom/heated_blanket/cmnd/POWER", curr_status.bedroom_blanket ? "on" : "off", true);
-    }
-    if (curr_status.led_strip_pc != prev_status.led_strip_pc) {
-        mqttPublish("wled/pc", curr_status.led_strip_pc ? "ON" : "OFF", true);
     }
 
     prev_status = curr_status;
@@ -454,5 +790,7 @@ void writeMQTT_bath_fan_force(int time) {
 
 void initMQTT() { }
 void runMQTT() { }
+String mqttStatus() { return String(); }
+void requestMQTTWrite() { }
 
 #endif // ENABLE_MQTT
@@ -0,0 +1,88 @@
+/*
+ * profiler.cpp
+ *
+ * ESP8266 / ESP32 Environmental Sensor
+ *
+ * Collects run time statistics of all scheduler jobs.
+ * Cheap enough (two micros() calls per job) to stay enabled.
+ *
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "profiler.h"
+
+#ifdef FEATURE_PROFILER
+
+static struct prof_stats slots[PROF_MAX_SLOTS];
+static int slot_count = 0;
+
+static void prof_clear(struct prof_stats *s) {
+    s->count = 0;
+    s->min = ULONG_MAX;
+    s->max = 0;
+    s->sum = 0;
+    for (int i = 0; i < PROF_BUCKETS; i++) {
+        s->hist[i] = 0;
+    }
+}
+
+int prof_add(const char *name) {
+    if (slot_count >= PROF_MAX_SLOTS) {
+        return -1;
+    }
+
+    slots[slot_count].name = name;
+    prof_clear(&slots[slot_count]);
+    return slot_count++;
+}
+
+void prof_record(int slot, unsigned long us) {
+    if ((slot < 0) || (slot >= slot_count)) {
+        return;
+    }
+
+    struct prof_stats *s = &slots[slot];
+    s->count++;
+    s->sum += us;
+    if (us < s->min) {
+        s->min = us;
+    }
+    if (us > s->max) {
+        s->max = us;
+    }
+
+    // floor(log2(us)), with 0us and 1us both in the first bucket
+    int bucket = (us > 1) ? (31 - __builtin_clz(us)) : 0;
+    if (bucket >= PROF_BUCKETS) {
+        bucket = PROF_BUCKETS - 1;
+    }
+    s->hist[bucket]++;
+}
+
+void prof_reset(void) {
+    for (int i = 0; i < slot_count; i++) {
+        prof_clear(&slots[i]);
+    }
+}
+
+int prof_count(void) {
+    return slot_count;
+}
+
+const struct prof_stats *prof_get(int slot) {
+    if ((slot < 0) || (slot >= slot_count)) {
+        return NULL;
+    }
+
+    return &slots[slot];
+}
+
+#endif // FEATURE_PROFILER
@@ -33,27 +33,27 @@ Turn ON the fourth relay  : A0 04 01 A5
 
 static int states[SERIAL_RELAIS_COUNT];
 
-static String names[SERIAL_RELAIS_COUNT] = {
+static const char *names[SERIAL_RELAIS_COUNT] = {
 #if defined(SENSOR_LOCATION_BATHROOM)
-    String("light_small"),
-    String("light_big"),
-    String("relais_2"),
-    String("fan")
+    "light_small",
+    "light_big",
+    "relais_2",
+    "fan"
 #elif defined(SENSOR_LOCATION_LIVINGROOM_WORKSPACE)
-    String("light_pc"),
-    String("light_bench"),
-    String("relais_w2"),
-    String("relais_w3")
+    "light_pc",
+    "light_bench",
+    "relais_w2",
+    "relais_w3"
 #elif defined(SENSOR_LOCATION_LIVINGROOM_TV)
-    String("light_amp"),
-    String("light_box"),
-    String("light_kitchen"),
-    String("relais_t3")
+    "light_amp",
+    "light_box",
+    "light_kitchen",
+    "relais_t3"
 #else
-    String("relais_0"),
-    String("relais_1"),
-    String("relais_2"),
-    String("relais_3")
+    "relais_0",
+    "relais_1",
+    "relais_2",
+    "relais_3"
 #endif
 };
 
@@ -110,9 +110,9 @@ int relais_get(int relais) {
     return states[relais];
 }
 
-String relais_name(int relais) {
+const char *relais_name(int relais) {
     if ((relais < 0) || (relais >= SERIAL_RELAIS_COUNT)) {
-        return String(F("Unknown"));
+        return "Unknown";
     }
 
     return names[relais];
@@ -130,17 +130,17 @@ static int gpios[GPIO_RELAIS_COUNT] = {
 
 static int states[GPIO_RELAIS_COUNT];
 
-static String names[GPIO_RELAIS_COUNT] = {
-    String(F("relais_0")),
-    String(F("relais_1")),
-    String(F("relais_2")),
-    String(F("relais_3")),
-    String(F("relais_4")),
-    String(F("relais_5")),
-    String(F("relais_6")),
-    String(F("relais_7")),
-    String(F("relais_8")),
-    String(F("relais_9"))
+static const char *names[GPIO_RELAIS_COUNT] = {
+    "relais_0",
+    "relais_1",
+    "relais_2",
+    "relais_3",
+    "relais_4",
+    "relais_5",
+    "relais_6",
+    "relais_7",
+    "relais_8",
+    "relais_9"
 };
 
 void relais_init(void) {
@@ -171,9 +171,9 @@ int relais_get(int relais) {
     return states[relais];
 }
 
-String relais_name(int relais) {
+const char *relais_name(int relais) {
     if ((relais < 0) || (relais >= GPIO_RELAIS_COUNT)) {
-        return String(F("Unknown"));
+        return "Unknown";
     }
 
     return names[relais];
@@ -0,0 +1,167 @@
+/*
+ * scheduler.cpp
+ *
+ * ESP8266 / ESP32 Environmental Sensor
+ *
+ * Simple cooperative deadline scheduler. Every subsystem registers its
+ * periodic or event triggered jobs here and loop() only calls sched_run().
+ * Time until the next deadline is spent in delay(), which lets the ESP8266
+ * SDK use modem-sleep and the ESP32 idle task run (and light-sleep, if
+ * power management is enabled).
+ *
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <xythobuz@xythobuz.de> wrote this file.  As long as you retain this notice
+ * you can do whatever you want with this stuff. If we meet some day, and you
+ * think this stuff is worth it, you can buy me a beer in return.   Thomas Buck
+ * ----------------------------------------------------------------------------
+ */
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "DebugLog.h"
+#include "profiler.h"
+#include "scheduler.h"
+
+static struct sched_job jobs[SCHED_MAX_JOBS];
+static int job_count = 0;
+
+#ifdef FEATURE_PROFILER
+static int loop_prof = -1;
+#endif // FEATURE_PROFILER
+
+int sched_add(const char *name, sched_func_t func, unsigned long interval) {
+    if (job_count >= SCHED_MAX_JOBS) {
+        debug.print(F("Scheduler full, dropping "));
+        debug.println(name);
+        return -1;
+    }
+
+    struct sched_job *j = &jobs[job_count];
+    j->name = name;
+    j->func = func;
+    j->interval = interval;
+    j->deadline = millis() + interval;
+    j->triggered = false;
+    j->armed = false;
+    j->runs = 0;
+    j->max_late = 0;
+
+#ifdef FEATURE_PROFILER
+    if (loop_prof < 0) {
+        loop_prof = prof_add("loop");
+    }
+    j->prof = prof_add(name);
+#else
+    j->prof = -1;
+#endif // FEATURE_PROFILER
+
+    return job_count++;
+}
+
+// called from pin interrupts, which may run while the flash cache is off
+#if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
+IRAM_ATTR
+#endif
+void sched_trigger(int job) {
+    if ((job < 0) || (job >= job_count)) {
+        return;
+    }
+
+    jobs[job].triggered = true;
+}
+
+void sched_trigger_in(int job, unsigned long delay) {
+    if ((job < 0) || (job >= job_count)) {
+        return;
+    }
+
+    jobs[job].deadline = millis() + delay;
+    jobs[job].armed = true;
+}
+
+static bool sched_has_deadline(struct sched_job *j) {
+    return (j->interval > 0) || j->armed;
+}
+
+static bool sched_due(struct sched_job *j, unsigned long now) {
+    return sched_has_deadline(j) && ((long)(now - j->deadline) >= 0);
+}
+
+void sched_run(void) {
+    unsigned long now = millis();
+
+#ifdef FEATURE_PROFILER
+    unsigned long loop_start = micros();
+#endif // FEATURE_PROFILER
+
+    for (int i = 0; i < job_count; i++) {
+        struct sched_job *j = &jobs[i];
+        bool due = sched_due(j, now);
+
+        if ((!due) && (!j->triggered)) {
+            continue;
+        }
+
+        if (due) {
+            unsigned long late = now - j->deadline;
+            if (late > j->max_late) {
+                j->max_late = late;
+            }
+
+            // keep the cycle drift-free, unless we fell behind a full interval
+            j->deadline += j->interval;
+            if ((long)(now - j->deadline) >= 0) {
+                j->deadline = now + j->interval;
+            }
+            j->armed = false;
+        }
+
+        j->triggered = false;
+
+#ifdef FEATURE_PROFILER
+        unsigned long start = micros();
+        j->func();
+        prof_record(j->prof, micros() - start);
+#else
+        j->func();
+#endif // FEATURE_PROFILER
+
+        j->runs++;
+
+        now = millis();
+    }
+
+#ifdef FEATURE_PROFILER
+    prof_record(loop_prof, micros() - loop_start);
+#endif // FEATURE_PROFILER
+
+    // sleep until the next job is due
+    unsigned long idle = SCHED_MAX_IDLE;
+    for (int i = 0; i < job_count; i++) {
+        struct sched_job *j = &jobs[i];
+
+        if (j->triggered || sched_due(j, now)) {
+            return;
+        }
+
+        if (sched_has_deadline(j) && ((j->deadline - now) < idle)) {
+            idle = j->deadline - now;
+        }
+    }
+
+    delay(idle);
+}
+
+int sched_count(void) {
+    return job_count;
+}
+
+const struct sched_job *sched_get(int job) {
+    if ((job < 0) || (job >= job_count)) {
+        return NULL;
+    }
+
+    return &jobs[job];
+}
@@ -28,6 +28,9 @@
 #include "memory.h"
 #include "servers.h"
 #include "html.h"
+#include "scheduler.h"
+#include "SensorFilter.h"
+#include "mqtt.h"
 #include "sensors.h"
 
 #if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
@@ -40,6 +43,20 @@
 #define CCS811_ADDRESS_1 0x5A
 #define CCS811_ADDRESS_2 0x5B
 
+// conversion times for max. resolution, page 5 of SHT21 datasheet, in ms
+#define SHT_TEMP_CONVERSION_TIME 85
+#define SHT_HUMID_CONVERSION_TIME 29
+#define SHT_POLL_INTERVAL 5
+#define SHT_TIMEOUT 250
+
+// plausible ranges, from the SHT21 and BME280 datasheets
+#define SENSOR_TEMP_MIN -40.0
+#define SENSOR_TEMP_MAX 85.0
+#define SENSOR_HUMID_MIN 0.0
+#define SENSOR_HUMID_MAX 100.0
+#define SENSOR_PRESSURE_MIN 30000.0
+#define SENSOR_PRESSURE_MAX 110000.0
+
 #if defined(ARDUINO_ARCH_ESP8266)
 
 #define I2C_SDA_PIN 2
@@ -62,6 +79,19 @@ bool found_bme2 = false;
 
 bool found_sht = false;
 
+enum sht_states {
+    SHT_IDLE = 0,
+    SHT_MEASURE_TEMP,
+    SHT_MEASURE_HUMID,
+};
+
+static enum sht_states sht_state = SHT_IDLE;
+static unsigned long sht_start_time = 0;
+static int sht_job = -1;
+
+static struct sensor_sample samples[SENSOR_NUM_CHANNELS];
+static SensorFilter filters[SENSOR_NUM_CHANNELS];
+
 #ifdef ENABLE_CCS811
 static Adafruit_CCS811 ccs1, ccs2;
 bool found_ccs1 = false;
@@ -72,90 +102,180 @@ int ccs1_error_code = 0;
 int ccs2_error_code = 0;
 #endif // ENABLE_CCS811
 
-static unsigned long last_sensor_handle_time = 0;
-
-#define DEF_SENSOR_READ_FUNC(n, v)        \
-float n(void) {                           \
-    while (1) {                           \
-        float a = v;                      \
-        float b = v;                      \
-                                          \
-        if ((a > b) && ((a - b) < 2.0)) { \
-            return (a + b) / 2.0;         \
-        }                                 \
-                                          \
-        if ((a < b) && ((b - a) < 2.0)) { \
-            return (a + b) / 2.0;         \
-        }                                 \
-                                          \
-        /* to keep wdt happy */           \
-        delay(1);                         \
-    }                                     \
-    return 0.0;                           \
+#ifdef ENABLE_BME280
+static float bme1_temp(void) { return bme1.readTemperature(); }
+static float bme2_temp(void) { return bme2.readTemperature(); }
+static float bme1_humid(void) { return bme1.readHumidity(); }
+static float bme2_humid(void) { return bme2.readHumidity(); }
+static float bme1_pressure(void) { return bme1.readPressure(); }
+static float bme2_pressure(void) { return bme2.readPressure(); }
+#endif // ENABLE_BME280
+
+const struct sensor_sample *sensor_get(enum sensor_channels channel) {
+    return &samples[channel];
+}
+
+static void sensor_store(enum sensor_channels channel, float value, bool valid) {
+    samples[channel].value = value;
+    samples[channel].time = millis();
+    samples[channel].valid = valid && (!isnan(value));
+
+    if (samples[channel].valid) {
+        requestMQTTWrite(); // deadband check, several samples cause one run
+    }
+}
+
+static void sensor_invalidate(enum sensor_channels channel) {
+    samples[channel].valid = false;
+}
+
+static void sensor_fail(enum sensor_channels channel) {
+    filters[channel].fail();
+    if (!filters[channel].valid()) {
+        sensor_invalidate(channel);
+    }
+}
+
+// feed an asynchronously acquired sample through the channel filter
+static void sensor_add(enum sensor_channels channel, float sample, float offset) {
+    if (filters[channel].add(sample)) {
+        sensor_store(channel, filters[channel].value() + offset, true);
+    } else {
+        sensor_fail(channel);
+    }
 }
 
+// synchronous read, bounded by the filter time and retry budget
+static void sensor_read(enum sensor_channels channel, sensor_read_t read) {
+    if (filters[channel].update(read)) {
+        sensor_store(channel, filters[channel].value(), true);
+    } else if (!filters[channel].valid()) {
+        sensor_invalidate(channel);
+    }
+}
+
+static void sensor_limits(void) {
+    filters[SENSOR_SHT_TEMP].setLimits(SENSOR_TEMP_MIN, SENSOR_TEMP_MAX);
+    filters[SENSOR_SHT_HUMID].setLimits(SENSOR_HUMID_MIN, SENSOR_HUMID_MAX);
+
 #ifdef ENABLE_BME280
-DEF_SENSOR_READ_FUNC(bme1_temp, bme1.readTemperature())
-DEF_SENSOR_READ_FUNC(bme2_temp, bme2.readTemperature())
-DEF_SENSOR_READ_FUNC(bme1_humid, bme1.readHumidity())
-DEF_SENSOR_READ_FUNC(bme2_humid, bme2.readHumidity())
-DEF_SENSOR_READ_FUNC(bme1_pressure, bme1.readPressure())
-DEF_SENSOR_READ_FUNC(bme2_pressure, bme2.readPressure())
+    filters[SENSOR_BME1_TEMP].setLimits(SENSOR_TEMP_MIN, SENSOR_TEMP_MAX);
+    filters[SENSOR_BME1_HUMID].setLimits(SENSOR_HUMID_MIN, SENSOR_HUMID_MAX);
+    filters[SENSOR_BME1_PRESSURE].setLimits(SENSOR_PRESSURE_MIN, SENSOR_PRESSURE_MAX);
+    filters[SENSOR_BME2_TEMP].setLimits(SENSOR_TEMP_MIN, SENSOR_TEMP_MAX);
+    filters[SENSOR_BME2_HUMID].setLimits(SENSOR_HUMID_MIN, SENSOR_HUMID_MAX);
+    filters[SENSOR_BME2_PRESSURE].setLimits(SENSOR_PRESSURE_MIN, SENSOR_PRESSURE_MAX);
 #endif // ENABLE_BME280
+}
 
-DEF_SENSOR_READ_FUNC(sht_temp, sht.GetTemperature() + config.sht_temp_off)
-DEF_SENSOR_READ_FUNC(sht_humid, sht.GetHumidity())
-
-#ifdef ENABLE_CCS811
+static bool sht_start(uint8_t command, unsigned long conversion_time) {
+    if (!sht.startMeasurement(command)) {
+        debug.println(F("SHT trigger failed"));
+        if (sht_state == SHT_IDLE) {
+            sensor_fail(SENSOR_SHT_TEMP);
+        }
+        sensor_fail(SENSOR_SHT_HUMID);
+        sht_state = SHT_IDLE;
+        return false;
+    }
 
-float ccs1_eco2(void) {
-    return ccs1.geteCO2();
+    sht_start_time = millis();
+    sched_trigger_in(sht_job, conversion_time);
+    return true;
 }
 
-float ccs1_tvoc(void) {
-    return ccs1.getTVOC();
+// returns true when a valid result has been read
+static bool sht_poll(uint16_t *raw) {
+    if (sht.readMeasurement(raw)) {
+        if (*raw == ERROR_CRC) {
+            debug.println(F("SHT CRC error"));
+            sensor_fail((sht_state == SHT_MEASURE_TEMP) ? SENSOR_SHT_TEMP : SENSOR_SHT_HUMID);
+            sht_state = SHT_IDLE;
+            return false;
+        }
+        return true;
+    }
+
+    if ((millis() - sht_start_time) >= SHT_TIMEOUT) {
+        debug.println(F("SHT timeout"));
+        sensor_fail((sht_state == SHT_MEASURE_TEMP) ? SENSOR_SHT_TEMP : SENSOR_SHT_HUMID);
+        sht_state = SHT_IDLE;
+    } else {
+        // still converting, look again soon
+        sched_trigger_in(sht_job, SHT_POLL_INTERVAL);
+    }
+    return false;
 }
 
-float ccs2_eco2(void) {
-    return ccs2.geteCO2();
+/*
+ * Non-blocking SHT21 state machine. Triggered by runSensors(), it
+ * re-schedules itself until temperature and humidity are converted,
+ * so the I2C bus and the main loop stay free in the meantime.
+ */
+static void runSHT(void) {
+    uint16_t raw;
+
+    switch (sht_state) {
+        case SHT_IDLE:
+            if (sht_start(TRIGGER_TEMP_MEASURE_NOHOLD, SHT_TEMP_CONVERSION_TIME)) {
+                sht_state = SHT_MEASURE_TEMP;
+            }
+            break;
+
+        case SHT_MEASURE_TEMP:
+            if (sht_poll(&raw)) {
+                sensor_add(SENSOR_SHT_TEMP, SHT2x::RawToTemperature(raw), config.sht_temp_off);
+                if (sht_start(TRIGGER_HUMD_MEASURE_NOHOLD, SHT_HUMID_CONVERSION_TIME)) {
+                    sht_state = SHT_MEASURE_HUMID;
+                }
+            }
+            break;
+
+        case SHT_MEASURE_HUMID:
+            if (sht_poll(&raw)) {
+                sensor_add(SENSOR_SHT_HUMID, SHT2x::RawToHumidity(raw), 0.0);
+                sht_state = SHT_IDLE;
+            }
+            break;
+    }
 }
 
-float ccs2_tvoc(void) {
-    return ccs2.getTVOC();
+#ifdef ENABLE_CCS811
+
+static void ccs_set_environment(Adafruit_CCS811 &ccs) {
+    if (found_sht && samples[SENSOR_SHT_TEMP].valid && samples[SENSOR_SHT_HUMID].valid) {
+        ccs.setEnvironmentalData(samples[SENSOR_SHT_HUMID].value, samples[SENSOR_SHT_TEMP].value);
+#ifdef ENABLE_BME280
+    } else if (found_bme1 && samples[SENSOR_BME1_TEMP].valid && samples[SENSOR_BME1_HUMID].valid) {
+        ccs.setEnvironmentalData(samples[SENSOR_BME1_HUMID].value, samples[SENSOR_BME1_TEMP].value);
+    } else if (found_bme2 && samples[SENSOR_BME2_TEMP].valid && samples[SENSOR_BME2_HUMID].valid) {
+        ccs.setEnvironmentalData(samples[SENSOR_BME2_HUMID].value, samples[SENSOR_BME2_TEMP].value);
+#endif // ENABLE_BME280
+    }
 }
 
 static void ccs_update() {
     if (found_ccs1) {
         if (ccs1.available()) {
-            if (found_sht) {
-                ccs1.setEnvironmentalData(sht_humid(), sht_temp());
-#ifdef ENABLE_BME280
-            } else if (found_bme1) {
-                ccs1.setEnvironmentalData(bme1_humid(), bme1_temp());
-            } else if (found_bme2) {
-                ccs1.setEnvironmentalData(bme2_humid(), bme2_temp());
-#endif // ENABLE_BME280
-            }
+            ccs_set_environment(ccs1);
 
             ccs1_error_code = ccs1.readData();
             ccs1_data_valid = (ccs1_error_code == 0);
+
+            sensor_store(SENSOR_CCS1_ECO2, ccs1.geteCO2(), ccs1_data_valid);
+            sensor_store(SENSOR_CCS1_TVOC, ccs1.getTVOC(), ccs1_data_valid);
         }
     }
 
     if (found_ccs2) {
         if (ccs2.available()) {
-            if (found_sht) {
-                ccs2.setEnvironmentalData(sht_humid(), sht_temp());
-#ifdef ENABLE_BME280
-            } else if (found_bme1) {
-                ccs2.setEnvironmentalData(bme1_humid(), bme1_temp());
-            } else if (found_bme2) {
-                ccs2.setEnvironmentalData(bme2_humid(), bme2_temp());
-#endif // ENABLE_BME280
-            }
+            ccs_set_environment(ccs2);
 
             ccs2_error_code = ccs2.readData();
             ccs2_data_valid = (ccs2_error_code == 0);
+
+            sensor_store(SENSOR_CCS2_ECO2, ccs2.geteCO2(), ccs2_data_valid);
+            sensor_store(SENSOR_CCS2_TVOC, ccs2.getTVOC(), ccs2_data_valid);
         }
     }
 }
@@ -172,16 +292,24 @@ void handleCalibrate() {
         diff = true;
         String off_string = server.arg("bme1");
         double real_temp = off_string.toDouble();
-        double meas_temp = bme1_temp() - config.bme1_temp_off;
+        double meas_temp = samples[SENSOR_BME1_TEMP].value - config.bme1_temp_off;
         config.bme1_temp_off = real_temp - meas_temp;
+        samples[SENSOR_BME1_TEMP].value = real_temp;
+
+        // old samples still contain the previous compensation
+        filters[SENSOR_BME1_TEMP].reset();
     }
 
     if (server.hasArg("bme2")) {
         diff = true;
         String off_string = server.arg("bme2");
         double real_temp = off_string.toDouble();
-        double meas_temp = bme2_temp() - config.bme2_temp_off;
+        double meas_temp = samples[SENSOR_BME2_TEMP].value - config.bme2_temp_off;
         config.bme2_temp_off = real_temp - meas_temp;
+        samples[SENSOR_BME2_TEMP].value = real_temp;
+
+        // old samples still contain the previous compensation
+        filters[SENSOR_BME2_TEMP].reset();
     }
 
 #endif // ENABLE_BME280
@@ -190,8 +318,9 @@ void handleCalibrate() {
         diff = true;
         String off_string = server.arg("sht");
         double real_temp = off_string.toDouble();
-        double meas_temp = sht_temp() - config.sht_temp_off;
+        double meas_temp = samples[SENSOR_SHT_TEMP].value - config.sht_temp_off;
         config.sht_temp_off = real_temp - meas_temp;
+        samples[SENSOR_SHT_TEMP].value = real_temp;
     }
 
     if (diff) {
@@ -214,6 +343,8 @@ void handleCalibrate() {
 #endif
 
 void initSensors() {
+    sensor_limits();
+
     // Init I2C and try to connect to sensors
 #if defined(ARDUINO_ARCH_ESP8266)
 
@@ -257,6 +388,9 @@ void initSensors() {
 
     debug.println(F("SHT"));
     found_sht = sht.GetAlive();
+    if (found_sht) {
+        sht_job = sched_add("sht", runSHT, 0);
+    }
 
 #ifdef ENABLE_BME280
     // initialize temperature offsets
@@ -267,18 +401,34 @@ void initSensors() {
         bme2.setTemperatureCompensation(config.bme2_temp_off);
     }
 #endif // ENABLE_BME280
+
+    // fill sample cache right away
+    int job = sched_add("sensors", runSensors, SENSOR_HANDLE_INTERVAL);
+    sched_trigger(job);
 }
 
 void runSensors() {
-    unsigned long time = millis();
+    if (found_sht && (sht_state == SHT_IDLE)) {
+        sched_trigger(sht_job);
+    }
+
+#ifdef ENABLE_BME280
+    if (found_bme1) {
+        sensor_read(SENSOR_BME1_TEMP, bme1_temp);
+        sensor_read(SENSOR_BME1_HUMID, bme1_humid);
+        sensor_read(SENSOR_BME1_PRESSURE, bme1_pressure);
+    }
 
-    if ((time - last_sensor_handle_time) >= SENSOR_HANDLE_INTERVAL) {
-        last_sensor_handle_time = time;
+    if (found_bme2) {
+        sensor_read(SENSOR_BME2_TEMP, bme2_temp);
+        sensor_read(SENSOR_BME2_HUMID, bme2_humid);
+        sensor_read(SENSOR_BME2_PRESSURE, bme2_pressure);
+    }
+#endif // ENABLE_BME280
 
 #ifdef ENABLE_CCS811
-        if (found_ccs1 || found_ccs2) {
-            ccs_update();
-        }
-#endif // ENABLE_CCS811
+    if (found_ccs1 || found_ccs2) {
+        ccs_update();
     }
+#endif // ENABLE_CCS811
 }
@@ -57,8 +57,7 @@ WiFiServer server(80);
 #include "influx.h"
 #include "mqtt.h"
 #include "html.h"
-
-static unsigned long last_server_handle_time = 0;
+#include "scheduler.h"
 
 void wifi_send_websocket(String s) {
 #ifdef ENABLE_WEBSOCKETS
@@ -84,7 +83,7 @@ static void handleOn(WiFiClient &client) {
         }
     }
 
-    writeDatabase();
+    requestDatabaseWrite();
 
 #if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
     handlePage(1, id);
@@ -109,7 +108,7 @@ static void handleOff(WiFiClient &client) {
         }
     }
 
-    writeDatabase();
+    requestDatabaseWrite();
 
 #if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
     handlePage(0, id);
@@ -138,6 +137,10 @@ void initServers(String hostname) {
     server.on("/reset", handleReset);
     server.on("/calibrate", handleCalibrate);
 
+#ifdef FEATURE_PROFILER
+    server.on("/profile", handleProfile);
+#endif // FEATURE_PROFILER
+
 #ifdef FEATURE_RELAIS
     server.on("/on", handleOn);
     server.on("/off", handleOff);
@@ -151,6 +154,8 @@ void initServers(String hostname) {
 #endif
 
     server.begin();
+
+    sched_add("servers", runServers, SERVER_HANDLE_INTERVAL);
 }
 
 #if defined(ARDUINO_ARCH_AVR)
@@ -218,16 +223,11 @@ static void handleServers() {
 }
 
 void runServers() {
-    unsigned long time = millis();
-
-    if ((time - last_server_handle_time) >= SERVER_HANDLE_INTERVAL) {
-        last_server_handle_time = time;
-        handleServers();
+    handleServers();
 
 #if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
 #ifdef ENABLE_WEBSOCKETS
-        socket.loop();
+    socket.loop();
 #endif // ENABLE_WEBSOCKETS
 #endif
-    }
 }
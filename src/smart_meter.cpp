@@ -20,6 +20,7 @@
 #include "config.h"
 #include "DebugLog.h"
 #include "lora.h"
+#include "scheduler.h"
 #include "smart_meter.h"
 
 #define SML_RX 33
@@ -98,14 +99,11 @@ void sml_init(void) {
     pinMode(SML_TX, OUTPUT);
 
     port.begin(SML_BAUD, SML_PARAM, SML_RX, SML_TX, false);
-}
 
-void sml_run(void) {
-    if (!port.available()) {
-        return;
-    }
+    sched_add("sml", sml_run, SML_HANDLE_INTERVAL);
+}
 
-    unsigned char c = port.read();
+static void sml_handle(unsigned char c) {
     sml_states_t s = smlState(c);
 
     if (s == SML_START) {
@@ -204,4 +202,11 @@ void sml_run(void) {
     }
 }
 
+void sml_run(void) {
+    // drain everything received since the last run
+    while (port.available()) {
+        sml_handle(port.read());
+    }
+}
+
 #endif // FEATURE_SML
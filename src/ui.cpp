@@ -27,6 +27,7 @@
 #include "DebugLog.h"
 #include "mqtt.h"
 #include "memory.h"
+#include "scheduler.h"
 #include "ui.h"
 
 #include <SPI.h>
@@ -53,6 +54,16 @@
 #define BTNS_OFF_X ((LCD_WIDTH - (2 * BTN_W) - (1 * BTN_GAP)) / 2)
 #define BTNS_OFF_Y ((LCD_HEIGHT - (3 * BTN_H) - (2 * BTN_GAP)) / 2)
 
+#define BTN_COLS 2
+#define BTN_ROWS 3
+#define BTN_LABEL_LEN 32
+
+#if defined(UI_SPRITE_DMA) && defined(UI_BUTTON_CACHE_SIZE)
+#define BTN_CACHE
+#define BTN_BITMAP_SIZE (BTN_W * BTN_H / 2) // 4bpp palette index per pixel
+#define SWAP16(c) ((uint16_t)(((c) >> 8) | ((c) << 8))) // 16bit sprites are byte swapped
+#endif
+
 #define INVERT_BOOL(x) (x) = !(x)
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
 #define MAX(a, b) (((a) > (b)) ? (a) : (b))
@@ -66,8 +77,13 @@
 #define LCD_MIN_BRIGHTNESS (STANDBY_BRIGHTNESS * 2)
 #define LCD_MAX_BRIGHTNESS 255
 
-#define MIN_TOUCH_DELAY_MS 200
 #define TOUCH_PRESSURE_MIN 1000
+#define TOUCH_SAMPLE_MS 5 // ADC read interval while the pen is down
+#define TOUCH_SAMPLES 5 // median filter window
+#define TOUCH_PRESS_SAMPLES 3 // debounce, samples with pressure before a press
+#define TOUCH_RELEASE_SAMPLES 4 // debounce, samples without pressure before a release
+#define TOUCH_LONG_PRESS_MS 1000
+#define TOUCH_QUEUE_LEN 8
 #define FULL_BRIGHT_MS (1000 * 30)
 #define NO_BRIGHT_MS (1000 * 2)
 
@@ -83,9 +99,41 @@
 #endif
 
 static SPIClass mySpi = SPIClass(HSPI);
-static XPT2046_Touchscreen ts(XPT2046_CS, XPT2046_IRQ);
+static XPT2046_Touchscreen ts(XPT2046_CS); // pen IRQ is handled here, see touch_isr()
 static TFT_eSPI tft = TFT_eSPI();
 
+#ifdef UI_SPRITE_DMA
+// two buffers, so the next button is composed while the last one is sent
+static TFT_eSprite btn_sprite[2] = { TFT_eSprite(&tft), TFT_eSprite(&tft) };
+static uint16_t *btn_buf[2] = { NULL, NULL };
+static int btn_next = 0;
+static bool btn_dma = false;
+static bool dma_busy = false;
+#endif // UI_SPRITE_DMA
+
+#ifdef BTN_CACHE
+enum btn_palette {
+    BTN_PAL_TEXT_BG = 0,
+    BTN_PAL_TEXT,
+    BTN_PAL_FILL,
+};
+
+// labels rendered once, the button color is only applied when copying
+struct btn_cache_entry {
+    char label[BTN_LABEL_LEN];
+    unsigned long last_use; // 0 for unused entries
+    uint8_t bitmap[BTN_BITMAP_SIZE];
+};
+
+#define BTN_CACHE_ENTRIES (UI_BUTTON_CACHE_SIZE / sizeof(struct btn_cache_entry))
+
+static TFT_eSprite btn_render = TFT_eSprite(&tft);
+static struct btn_cache_entry *btn_cache = NULL;
+static unsigned long btn_cache_uses = 0;
+static unsigned long btn_cache_hits = 0;
+static unsigned long btn_cache_misses = 0;
+#endif // BTN_CACHE
+
 enum ui_state ui_init_state = UI_INIT;
 struct ui_status ui_status = {0};
 
@@ -102,255 +150,349 @@ enum ui_pages {
     UI_NUM_PAGES
 };
 
-const char *ui_page_names[UI_NUM_PAGES] = {
-    "Start",
-    "Livingroom Main",
-    "Livingroom Lights",
-    "Kitchen / Livingroom",
-    "Bathroom Fan",
-    "Bathroom Lights",
-    "Bedroom",
-    "Info",
-};
+#if defined(SENSOR_LOCATION_BATHROOM)
+#define UI_DEFAULT_PAGE UI_BATHROOM1
+#elif defined(SENSOR_LOCATION_BEDROOM)
+#define UI_DEFAULT_PAGE UI_BEDROOM
+#else
+#define UI_DEFAULT_PAGE UI_LIVINGROOM1
+#endif
 
 static enum ui_pages ui_page = UI_START;
-static bool is_touched = false;
+static bool touch_woke = false;
+static bool touch_next_pending = false; // next button pressed, acts on release
 static unsigned long last_ldr = 0;
 static float ldr_value = 0;
 static unsigned long last_touch_time = 0;
 static int curr_brightness = LCD_MAX_BRIGHTNESS;
 static int set_max_brightness = LCD_MAX_BRIGHTNESS;
 static unsigned long last_standby_draw = 0;
+static bool ui_dirty = false;
+static unsigned long last_redraw = 0;
+static unsigned long redraws = 0;
+static unsigned long redraws_skipped = 0;
+
+// what is currently on the screen, to only repaint changed buttons
+struct ui_widget {
+    bool valid;
+    uint32_t color;
+    char label[BTN_LABEL_LEN];
+};
 
-static String ui_page_to_str(enum ui_pages page) {
-    return String(ui_page_names[page]);
-}
+static struct ui_widget widgets[BTN_COLS * BTN_ROWS];
+static enum ui_pages drawn_page = UI_NUM_PAGES;
+static unsigned long widgets_drawn = 0;
+static unsigned long widgets_unchanged = 0;
+static unsigned long frame_last[UI_NUM_PAGES] = {0};
+static unsigned long frame_max[UI_NUM_PAGES] = {0};
 
 static void ledcAnalogWrite(uint8_t channel, uint32_t value, uint32_t valueMax = 255) {
     uint32_t duty = (4095 / valueMax) * min(value, valueMax);
     ledcWrite(channel, duty);
 }
 
-static void draw_button(const char *name, uint32_t x, uint32_t y, uint32_t color) {
+// wait for the last button transfer, before anything else uses the display
+static void ui_dma_finish(void) {
+#ifdef UI_SPRITE_DMA
+    if (dma_busy) {
+        tft.dmaWait();
+        tft.endWrite();
+        dma_busy = false;
+    }
+#endif // UI_SPRITE_DMA
+}
+
+// screen contents unknown, next ui_draw_menu() starts from scratch
+static void ui_invalidate(void) {
+    drawn_page = UI_NUM_PAGES;
+}
+
+#ifdef BTN_CACHE
+static const uint8_t *btn_cache_get(const char *name) {
+    struct btn_cache_entry *victim = &btn_cache[0];
+    btn_cache_uses++;
+
+    for (unsigned int i = 0; i < BTN_CACHE_ENTRIES; i++) {
+        struct btn_cache_entry *e = &btn_cache[i];
+        if ((e->last_use != 0) && (strncmp(e->label, name, BTN_LABEL_LEN - 1) == 0)) {
+            e->last_use = btn_cache_uses;
+            btn_cache_hits++;
+            return e->bitmap;
+        }
+
+        // least recently used, or empty
+        if (e->last_use < victim->last_use) {
+            victim = e;
+        }
+    }
+
+    btn_cache_misses++;
+    btn_render.fillSprite(BTN_PAL_FILL);
+    btn_render.drawString(name, BTN_W / 2, BTN_H / 2, 2);
+    memcpy(victim->bitmap, btn_render.getPointer(), BTN_BITMAP_SIZE);
+
+    strncpy(victim->label, name, BTN_LABEL_LEN - 1);
+    victim->label[BTN_LABEL_LEN - 1] = '\0';
+    victim->last_use = btn_cache_uses;
+    return victim->bitmap;
+}
+
+static void btn_cache_blit(const uint8_t *bitmap, uint16_t *buf, uint16_t color) {
+    uint16_t pal[16];
+    for (int i = 0; i < 16; i++) {
+        pal[i] = SWAP16(color);
+    }
+    pal[BTN_PAL_TEXT_BG] = SWAP16(TFT_BLACK);
+    pal[BTN_PAL_TEXT] = SWAP16(TFT_WHITE);
+
+    for (int i = 0; i < BTN_BITMAP_SIZE; i++) {
+        *buf++ = pal[bitmap[i] >> 4]; // left pixel in high nibble
+        *buf++ = pal[bitmap[i] & 0x0F];
+    }
+}
+#endif // BTN_CACHE
+
+#ifdef UI_SPRITE_DMA
+static void btn_compose(int n, const char *name, uint32_t color) {
+#ifdef BTN_CACHE
+    if (btn_cache != NULL) {
+        btn_cache_blit(btn_cache_get(name), btn_buf[n], color);
+        return;
+    }
+#endif // BTN_CACHE
+
+    btn_sprite[n].fillSprite(color);
+    btn_sprite[n].drawString(name, BTN_W / 2, BTN_H / 2, 2);
+}
+#endif // UI_SPRITE_DMA
+
+static void draw_button(int slot, const char *name, uint32_t color) {
+    struct ui_widget *w = &widgets[slot];
+    int x = BTNS_OFF_X + BTN_W / 2 + (slot / BTN_ROWS) * (BTN_W + BTN_GAP);
+    int y = BTNS_OFF_Y + BTN_H / 2 + (slot % BTN_ROWS) * (BTN_H + BTN_GAP);
+
+    if (w->valid && (w->color == color) && (strncmp(w->label, name, BTN_LABEL_LEN - 1) == 0)) {
+        widgets_unchanged++;
+        return;
+    }
+
+    w->valid = true;
+    w->color = color;
+    strncpy(w->label, name, BTN_LABEL_LEN - 1);
+    w->label[BTN_LABEL_LEN - 1] = '\0';
+    widgets_drawn++;
+
+#ifdef UI_SPRITE_DMA
+    if (btn_dma) {
+        btn_compose(btn_next, name, color);
+
+        if (!dma_busy) {
+            tft.startWrite();
+            dma_busy = true;
+        }
+
+        // waits for the previous transfer, which used the other buffer
+        tft.pushImageDMA(x - BTN_W / 2, y - BTN_H / 2, BTN_W, BTN_H, btn_buf[btn_next]);
+        btn_next ^= 1;
+        return;
+    }
+#endif // UI_SPRITE_DMA
+
     tft.fillRect(x - BTN_W / 2, y - BTN_H / 2, BTN_W, BTN_H, color);
 
     tft.setTextDatum(MC_DATUM); // middle center
     tft.drawString(name, x, y, 2);
 }
 
-static void draw_livingroom1(void) {
-    // 1
-    draw_button("Lights Corner",
-                BTNS_OFF_X + BTN_W / 2,
-                BTNS_OFF_Y + BTN_H / 2,
-                ui_status.light_corner ? TFT_GREEN : TFT_RED);
-
-    // 2
-    draw_button("Lights Workspace",
-                BTNS_OFF_X + BTN_W / 2,
-                BTNS_OFF_Y + BTN_H / 2 + BTN_H + BTN_GAP,
-                ui_status.light_workspace ? TFT_GREEN : TFT_RED);
-
-    // 3
-    draw_button("Sound Amp.",
-                BTNS_OFF_X + BTN_W / 2,
-                BTNS_OFF_Y + BTN_H / 2 + (BTN_H + BTN_GAP) * 2,
-                ui_status.sound_amplifier ? TFT_GREEN : TFT_RED);
-
-    // 4
-    draw_button("LED Strip",
-                BTNS_OFF_X + BTN_W / 2 + BTN_W + BTN_GAP,
-                BTNS_OFF_Y + BTN_H / 2,
-                ui_status.led_strip_pc ? TFT_GREEN : TFT_RED);
-
-    // 5
-    bool on = ui_status.light_corner || ui_status.light_sink || ui_status.light_workspace
-            || ui_status.light_amp || ui_status.light_bench || ui_status.light_box
-            || ui_status.light_kitchen || ui_status.light_pc || ui_status.pc_displays;
-    draw_button(on ? "All Lights Off" : "Wake Up Lights",
-                BTNS_OFF_X + BTN_W / 2 + BTN_W + BTN_GAP,
-                BTNS_OFF_Y + BTN_H / 2 + BTN_H + BTN_GAP,
-                TFT_MAGENTA);
-}
-
-static void draw_livingroom2(void) {
-    // 1
-    draw_button("Lights PC",
-                BTNS_OFF_X + BTN_W / 2,
-                BTNS_OFF_Y + BTN_H / 2,
-                ui_status.light_pc ? TFT_GREEN : TFT_RED);
-
-    // 2
-    draw_button("Lights Bench",
-                BTNS_OFF_X + BTN_W / 2,
-                BTNS_OFF_Y + BTN_H / 2 + BTN_H + BTN_GAP,
-                ui_status.light_bench ? TFT_GREEN : TFT_RED);
-
-    // 3
-    bool on = ui_status.light_amp || ui_status.light_bench || ui_status.light_box
-    || ui_status.light_kitchen || ui_status.light_pc;
-    draw_button(on ? "Big Lights Off" : "Big Lights On",
-                BTNS_OFF_X + BTN_W / 2,
-                BTNS_OFF_Y + BTN_H / 2 + (BTN_H + BTN_GAP) * 2,
-                TFT_MAGENTA);
-
-    // 4
-    draw_button("Lights Amp.",
-                BTNS_OFF_X + BTN_W / 2 + BTN_W + BTN_GAP,
-                BTNS_OFF_Y + BTN_H / 2,
-                ui_status.light_amp ? TFT_GREEN : TFT_RED);
-
-    // 5
-    draw_button("Lights Box",
-                BTNS_OFF_X + BTN_W / 2 + BTN_W + BTN_GAP,
-                BTNS_OFF_Y + BTN_H / 2 + BTN_H + BTN_GAP,
-                ui_status.light_box ? TFT_GREEN : TFT_RED);
-}
-
-static void draw_livingroom3(void) {
-    String s_temp = "Temp.: ";
-    s_temp += String(ui_status.livingroom_temperature);
-    s_temp += "C";
-
-    String s_humid = "Humid.: ";
-    s_humid += String(ui_status.livingroom_humidity);
-    s_humid += "%";
-
-    // 1
-    draw_button("PC Displays",
-                BTNS_OFF_X + BTN_W / 2,
-                BTNS_OFF_Y + BTN_H / 2,
-                ui_status.pc_displays ? TFT_GREEN : TFT_RED);
-
-    // 2
-    draw_button(s_temp.c_str(),
-                BTNS_OFF_X + BTN_W / 2,
-                BTNS_OFF_Y + BTN_H / 2 + BTN_H + BTN_GAP,
-                TFT_YELLOW);
-
-    // 3
-    draw_button(s_humid.c_str(),
-                BTNS_OFF_X + BTN_W / 2,
-                BTNS_OFF_Y + BTN_H / 2 + (BTN_H + BTN_GAP) * 2,
-                TFT_YELLOW);
-
-    // 4
-    draw_button("Lights Kitchen",
-                BTNS_OFF_X + BTN_W / 2 + BTN_W + BTN_GAP,
-                BTNS_OFF_Y + BTN_H / 2,
-                ui_status.light_kitchen ? TFT_GREEN : TFT_RED);
-
-    // 5
-    draw_button("Lights Sink",
-                BTNS_OFF_X + BTN_W / 2 + BTN_W + BTN_GAP,
-                BTNS_OFF_Y + BTN_H / 2 + BTN_H + BTN_GAP,
-                ui_status.light_sink ? TFT_GREEN : TFT_RED);
-}
-
-static void draw_bathroom1(void) {
-    String s_temp = "Temp.: ";
-    s_temp += String(ui_status.bathroom_temperature);
-    s_temp += "C";
-
-    String s_humid = "Humid.: ";
-    s_humid += String(ui_status.bathroom_humidity);
-    s_humid += "%";
-
-    // 1
-    draw_button("Bath Fan Status",
-                BTNS_OFF_X + BTN_W / 2,
-                BTNS_OFF_Y + BTN_H / 2,
-                ui_status.bathroom_fan ? TFT_GREEN : TFT_RED);
-
-    // 2
-    draw_button("Bath Fan 120min",
-                BTNS_OFF_X + BTN_W / 2,
-                BTNS_OFF_Y + BTN_H / 2 + BTN_H + BTN_GAP,
-                TFT_MAGENTA);
-
-    // 3
-    // empty
-
-    // 4
-    draw_button(s_temp.c_str(),
-                BTNS_OFF_X + BTN_W / 2 + BTN_W + BTN_GAP,
-                BTNS_OFF_Y + BTN_H / 2,
-                TFT_YELLOW);
-
-    // 5
-    draw_button(s_humid.c_str(),
-                BTNS_OFF_X + BTN_W / 2 + BTN_W + BTN_GAP,
-                BTNS_OFF_Y + BTN_H / 2 + BTN_H + BTN_GAP,
-                TFT_YELLOW);
-}
-
-static void draw_bathroom2(void) {
-    // 1
-    draw_button("Bath Lights Auto",
-                BTNS_OFF_X + BTN_W / 2,
-                BTNS_OFF_Y + BTN_H / 2,
-                ui_status.bathroom_lights == BATH_LIGHT_NONE ? TFT_GREEN : TFT_RED);
-
-    // 2
-    draw_button("Bath Lights Big",
-                BTNS_OFF_X + BTN_W / 2,
-                BTNS_OFF_Y + BTN_H / 2 + BTN_H + BTN_GAP,
-                ui_status.bathroom_lights == BATH_LIGHT_BIG ? TFT_GREEN : TFT_RED);
-
-    // 3
-    draw_button("Bath Lights Both",
-                BTNS_OFF_X + BTN_W / 2,
-                BTNS_OFF_Y + BTN_H / 2 + (BTN_H + BTN_GAP) * 2,
-                ui_status.bathroom_lights == BATH_LIGHT_BOTH ? TFT_GREEN : TFT_RED);
-
-    // 4
-    draw_button("Bath Lights Off",
-                BTNS_OFF_X + BTN_W / 2 + BTN_W + BTN_GAP,
-                BTNS_OFF_Y + BTN_H / 2,
-                ui_status.bathroom_lights == BATH_LIGHT_OFF ? TFT_GREEN : TFT_RED);
-
-    // 5
-    draw_button("Bath Lights Small",
-                BTNS_OFF_X + BTN_W / 2 + BTN_W + BTN_GAP,
-                BTNS_OFF_Y + BTN_H / 2 + BTN_H + BTN_GAP,
-                ui_status.bathroom_lights == BATH_LIGHT_SMALL ? TFT_GREEN : TFT_RED);
-}
-
-static void draw_bedroom(void) {
-    String s_temp = "Temp.: ";
-    s_temp += String(ui_status.bedroom_temperature);
-    s_temp += "C";
-
-    String s_humid = "Humid.: ";
-    s_humid += String(ui_status.bedroom_humidity);
-    s_humid += "%";
-
-    // 1
-    draw_button("Nightstand 1 Lights",
-                BTNS_OFF_X + BTN_W / 2,
-                BTNS_OFF_Y + BTN_H / 2,
-                ui_status.light_nightstand1 ? TFT_GREEN : TFT_RED);
-
-    // 2
-    draw_button("Heated Blanket",
-                BTNS_OFF_X + BTN_W / 2,
-                BTNS_OFF_Y + BTN_H / 2 + BTN_H + BTN_GAP,
-                ui_status.bedroom_blanket ? TFT_GREEN : TFT_RED);
-
-    // 3
-    // empty
-
-    // 4
-    draw_button(s_temp.c_str(),
-                BTNS_OFF_X + BTN_W / 2 + BTN_W + BTN_GAP,
-                BTNS_OFF_Y + BTN_H / 2,
-                TFT_YELLOW);
-
-    // 5
-    draw_button(s_humid.c_str(),
-                BTNS_OFF_X + BTN_W / 2 + BTN_W + BTN_GAP,
-                BTNS_OFF_Y + BTN_H / 2 + BTN_H + BTN_GAP,
-                TFT_YELLOW);
+static bool *ui_bool(size_t field) {
+    return (bool *)((uint8_t *)&ui_status + field);
+}
+
+static float *ui_float(size_t field) {
+    return (float *)((uint8_t *)&ui_status + field);
+}
+
+static bool lights_any_on(void) {
+    return ui_status.light_corner || ui_status.light_sink || ui_status.light_workspace
+        || ui_status.light_amp || ui_status.light_bench || ui_status.light_box
+        || ui_status.light_kitchen || ui_status.light_pc || ui_status.pc_displays
+        || ui_status.light_nightstand1 || ui_status.led_strip_pc;
+}
+
+static void lights_all_toggle(void) {
+    if (lights_any_on()) {
+        ui_status.light_amp = false;
+        ui_status.light_kitchen = false;
+        ui_status.light_bench= false;
+        ui_status.light_workspace = false;
+        ui_status.light_pc = false;
+        ui_status.light_corner = false;
+        ui_status.light_box = false;
+        ui_status.light_sink = false;
+        ui_status.light_nightstand1 = false;
+        ui_status.pc_displays = false;
+        ui_status.led_strip_pc = false;
+    } else {
+        ui_status.light_corner = true;
+        ui_status.light_sink = true;
+        ui_status.pc_displays = true;
+        ui_status.led_strip_pc = true;
+    }
+}
+
+static bool lights_big_on(void) {
+    return ui_status.light_amp || ui_status.light_bench || ui_status.light_box
+        || ui_status.light_kitchen || ui_status.light_pc;
+}
+
+static void lights_big_toggle(void) {
+    bool on = lights_big_on();
+    ui_status.light_amp = !on;
+    ui_status.light_bench = !on;
+    ui_status.light_box = !on;
+    ui_status.light_kitchen = !on;
+    ui_status.light_pc = !on;
+}
+
+static void bath_fan_120min(void) {
+    writeMQTT_bath_fan_force(120);
+}
+
+enum ui_button_type {
+    UI_BTN_NONE = 0, // empty slot
+    UI_BTN_TOGGLE, // bool field, green when on
+    UI_BTN_STATUS, // like toggle, but can't be changed from here
+    UI_BTN_BATH_LIGHT, // green when bathroom_lights has this value
+    UI_BTN_VALUE, // float field with unit
+    UI_BTN_ACTION, // runs action()
+    UI_BTN_NEXT, // next page on release, long press for info page
+};
+
+struct ui_button {
+    enum ui_button_type type;
+    const char *label;
+    const char *alt; // ACTION: label while state() is true, VALUE: unit
+    size_t field; // in struct ui_status, published by writeMQTT_UI()
+    int value; // BATH_LIGHT: state selected by this button
+    bool (*state)(void);
+    void (*action)(void);
+};
+
+struct ui_page_def {
+    const char *name;
+    struct ui_button buttons[BTN_COLS * BTN_ROWS]; // column by column
+};
+
+#define BTN_EMPTY { UI_BTN_NONE }
+#define BTN_TOGGLE(l, f) { UI_BTN_TOGGLE, l, NULL, UI_FIELD(f) }
+#define BTN_STATUS(l, f) { UI_BTN_STATUS, l, NULL, UI_FIELD(f) }
+#define BTN_BATH_LIGHT(l, v) { UI_BTN_BATH_LIGHT, l, NULL, UI_FIELD(bathroom_lights), v }
+#define BTN_VALUE(l, f, u) { UI_BTN_VALUE, l, u, UI_FIELD(f) }
+#define BTN_ACTION(l, l_on, s, a) { UI_BTN_ACTION, l, l_on, 0, 0, s, a }
+#define BTN_NEXT { UI_BTN_NEXT, "Next..." }
+
+static const struct ui_page_def ui_page_defs[UI_NUM_PAGES] = {
+    { "Start" },
+    { "Livingroom Main", {
+        BTN_TOGGLE("Lights Corner", light_corner),
+        BTN_TOGGLE("Lights Workspace", light_workspace),
+        BTN_TOGGLE("Sound Amp.", sound_amplifier),
+        BTN_TOGGLE("LED Strip", led_strip_pc),
+        BTN_ACTION("Wake Up Lights", "All Lights Off", lights_any_on, lights_all_toggle),
+        BTN_NEXT,
+    } },
+    { "Livingroom Lights", {
+        BTN_TOGGLE("Lights PC", light_pc),
+        BTN_TOGGLE("Lights Bench", light_bench),
+        BTN_ACTION("Big Lights On", "Big Lights Off", lights_big_on, lights_big_toggle),
+        BTN_TOGGLE("Lights Amp.", light_amp),
+        BTN_TOGGLE("Lights Box", light_box),
+        BTN_NEXT,
+    } },
+    { "Kitchen / Livingroom", {
+        BTN_TOGGLE("PC Displays", pc_displays),
+        BTN_VALUE("Temp.: ", livingroom_temperature, "C"),
+        BTN_VALUE("Humid.: ", livingroom_humidity, "%"),
+        BTN_TOGGLE("Lights Kitchen", light_kitchen),
+        BTN_TOGGLE("Lights Sink", light_sink),
+        BTN_NEXT,
+    } },
+    { "Bathroom Fan", {
+        BTN_STATUS("Bath Fan Status", bathroom_fan),
+        BTN_ACTION("Bath Fan 120min", NULL, NULL, bath_fan_120min),
+        BTN_EMPTY,
+        BTN_VALUE("Temp.: ", bathroom_temperature, "C"),
+        BTN_VALUE("Humid.: ", bathroom_humidity, "%"),
+        BTN_NEXT,
+    } },
+    { "Bathroom Lights", {
+        BTN_BATH_LIGHT("Bath Lights Auto", BATH_LIGHT_NONE),
+        BTN_BATH_LIGHT("Bath Lights Big", BATH_LIGHT_BIG),
+        BTN_BATH_LIGHT("Bath Lights Both", BATH_LIGHT_BOTH),
+        BTN_BATH_LIGHT("Bath Lights Off", BATH_LIGHT_OFF),
+        BTN_BATH_LIGHT("Bath Lights Small", BATH_LIGHT_SMALL),
+        BTN_NEXT,
+    } },
+    { "Bedroom", {
+        BTN_TOGGLE("Nightstand 1 Lights", light_nightstand1),
+        BTN_STATUS("Heated Blanket", bedroom_blanket),
+        BTN_EMPTY,
+        BTN_VALUE("Temp.: ", bedroom_temperature, "C"),
+        BTN_VALUE("Humid.: ", bedroom_humidity, "%"),
+        BTN_NEXT,
+    } },
+    { "Info" },
+};
+
+// slot of the button at this screen position, or -1
+static int ui_slot_at(int x, int y) {
+    int dx = x - BTNS_OFF_X;
+    int dy = y - BTNS_OFF_Y;
+    if ((dx < 0) || (dy < 0)) {
+        return -1;
+    }
+
+    int col = dx / (BTN_W + BTN_GAP);
+    int row = dy / (BTN_H + BTN_GAP);
+    if ((col >= BTN_COLS) || (row >= BTN_ROWS)
+            || ((dx % (BTN_W + BTN_GAP)) >= BTN_W) || ((dy % (BTN_H + BTN_GAP)) >= BTN_H)) {
+        return -1; // in the gap between buttons
+    }
+
+    return col * BTN_ROWS + row;
+}
+
+static void draw_slot(int slot) {
+    const struct ui_button *b = &ui_page_defs[ui_page].buttons[slot];
+
+    switch (b->type) {
+        case UI_BTN_NONE:
+            break;
+
+        case UI_BTN_TOGGLE:
+        case UI_BTN_STATUS:
+            draw_button(slot, b->label, *ui_bool(b->field) ? TFT_GREEN : TFT_RED);
+            break;
+
+        case UI_BTN_BATH_LIGHT:
+            draw_button(slot, b->label, (ui_status.bathroom_lights == b->value) ? TFT_GREEN : TFT_RED);
+            break;
+
+        case UI_BTN_VALUE: {
+            String s = b->label;
+            s += String(*ui_float(b->field));
+            s += b->alt;
+            draw_button(slot, s.c_str(), TFT_YELLOW);
+        } break;
+
+        case UI_BTN_ACTION:
+            draw_button(slot, ((b->state != NULL) && b->state()) ? b->alt : b->label, TFT_MAGENTA);
+            break;
+
+        case UI_BTN_NEXT:
+            draw_button(slot, b->label, TFT_CYAN);
+            break;
+    }
 }
 
 static void draw_info(void) {
@@ -402,6 +544,164 @@ static void draw_standby(void) {
     tft.drawString("Touch to begin...", LCD_WIDTH / 2, LCD_HEIGHT, 2);
 }
 
+static TS_Point touchToScreen(TS_Point p) {
+    p.x = map(p.x, config.touch_calibrate_left, config.touch_calibrate_right, CALIB_1_X, CALIB_2_X);
+    p.y = map(p.y, config.touch_calibrate_top, config.touch_calibrate_bottom, CALIB_1_Y, CALIB_2_Y);
+    if (p.x < 0) { p.x = 0; }
+    if (p.x >= LCD_WIDTH) { p.x = LCD_WIDTH - 1; }
+    if (p.y < 0) { p.y = 0; }
+    if (p.y >= LCD_HEIGHT) { p.y = LCD_HEIGHT - 1; }
+    return p;
+}
+
+enum touch_event_type {
+    TOUCH_PRESS = 0,
+    TOUCH_RELEASE,
+    TOUCH_LONG_PRESS,
+};
+
+struct touch_event {
+    enum touch_event_type type;
+    int16_t x, y;
+};
+
+enum touch_state {
+    TOUCH_IDLE = 0,
+    TOUCH_DOWN,
+    TOUCH_HELD, // long press already reported
+};
+
+// filled by the touch job, emptied by ui_run(). both run from the scheduler.
+static struct touch_event touch_queue[TOUCH_QUEUE_LEN];
+static int touch_head = 0;
+static int touch_tail = 0;
+static unsigned long touch_events = 0;
+static unsigned long touch_dropped = 0;
+
+static int touch_job = -1;
+static enum touch_state touch_state = TOUCH_IDLE;
+static int16_t touch_xs[TOUCH_SAMPLES];
+static int16_t touch_ys[TOUCH_SAMPLES];
+static int touch_count = 0; // samples with pressure, since pen down
+static int touch_misses = 0; // samples without pressure, in a row
+static unsigned long touch_down_time = 0;
+
+// set by the pen IRQ, cleared by the touch job when it stops sampling
+static volatile bool touch_active = false;
+static volatile unsigned long touch_wakeups = 0;
+static volatile unsigned long touch_irq_ignored = 0;
+
+static void IRAM_ATTR touch_isr(void) {
+    // PENIRQ also glitches low during the conversions of the controller
+    if (touch_active) {
+        touch_irq_ignored++;
+        return;
+    }
+
+    touch_active = true;
+    touch_wakeups++;
+    sched_trigger(touch_job);
+}
+
+static void touch_push(enum touch_event_type type) {
+    int next = (touch_head + 1) % TOUCH_QUEUE_LEN;
+    if (next == touch_tail) {
+        touch_dropped++;
+        return;
+    }
+
+    // median of the last samples, single outliers don't move the point
+    int n = MIN(touch_count, TOUCH_SAMPLES);
+    int16_t xs[TOUCH_SAMPLES], ys[TOUCH_SAMPLES];
+    for (int i = 0; i < n; i++) {
+        int16_t x = touch_xs[i], y = touch_ys[i];
+        int j = i;
+        for (; (j > 0) && (xs[j - 1] > x); j--) {
+            xs[j] = xs[j - 1];
+        }
+        xs[j] = x;
+        for (j = i; (j > 0) && (ys[j - 1] > y); j--) {
+            ys[j] = ys[j - 1];
+        }
+        ys[j] = y;
+    }
+
+    touch_queue[touch_head].type = type;
+    touch_queue[touch_head].x = (n > 0) ? xs[n / 2] : 0;
+    touch_queue[touch_head].y = (n > 0) ? ys[n / 2] : 0;
+    touch_head = next;
+    touch_events++;
+}
+
+static bool touch_pop(struct touch_event *e) {
+    if (touch_tail == touch_head) {
+        return false;
+    }
+
+    *e = touch_queue[touch_tail];
+    touch_tail = (touch_tail + 1) % TOUCH_QUEUE_LEN;
+    return true;
+}
+
+// started by the pen IRQ, samples the panel only while it is touched
+static void touch_run(void) {
+    TS_Point p = ts.getPoint();
+    bool pressed = p.z >= TOUCH_PRESSURE_MIN;
+
+    if (pressed) {
+        p = touchToScreen(p);
+        touch_xs[touch_count % TOUCH_SAMPLES] = p.x;
+        touch_ys[touch_count % TOUCH_SAMPLES] = p.y;
+        touch_count++;
+        touch_misses = 0;
+    } else {
+        touch_misses++;
+    }
+
+    bool released = touch_misses >= TOUCH_RELEASE_SAMPLES;
+
+    switch (touch_state) {
+        case TOUCH_IDLE:
+            if (pressed && (touch_count >= TOUCH_PRESS_SAMPLES)) {
+                touch_push(TOUCH_PRESS);
+                touch_state = TOUCH_DOWN;
+                touch_down_time = millis();
+            }
+            break;
+
+        case TOUCH_DOWN:
+            if (released) {
+                touch_push(TOUCH_RELEASE);
+            } else if ((millis() - touch_down_time) >= TOUCH_LONG_PRESS_MS) {
+                touch_push(TOUCH_LONG_PRESS);
+                touch_state = TOUCH_HELD;
+            }
+            break;
+
+        case TOUCH_HELD:
+            if (released) {
+                touch_push(TOUCH_RELEASE);
+            }
+            break;
+    }
+
+    if (released) {
+        // also drops short bounces that never became a press
+        touch_state = TOUCH_IDLE;
+        touch_count = 0;
+        touch_misses = 0;
+
+        // IRQ only fires on the falling edge, keep looking while it is low
+        touch_active = false;
+        if (digitalRead(XPT2046_IRQ)) {
+            return;
+        }
+        touch_active = true;
+    }
+
+    sched_trigger_in(touch_job, TOUCH_SAMPLE_MS);
+}
+
 void ui_init(void) {
     mySpi.begin(XPT2046_CLK, XPT2046_MISO, XPT2046_MOSI, XPT2046_CS);
     ts.begin(mySpi);
@@ -421,6 +721,40 @@ void ui_init(void) {
     tft.writedata(1);
 #endif // UI_LCD_TWO_USB_PORTS
 
+#ifdef UI_SPRITE_DMA
+    btn_dma = tft.initDMA();
+    for (int i = 0; btn_dma && (i < 2); i++) {
+        btn_sprite[i].setColorDepth(16);
+        btn_buf[i] = (uint16_t *)btn_sprite[i].createSprite(BTN_W, BTN_H);
+        btn_sprite[i].setTextColor(TFT_WHITE, TFT_BLACK, true);
+        btn_sprite[i].setTextDatum(MC_DATUM); // middle center
+        if (btn_buf[i] == NULL) {
+            btn_dma = false;
+        }
+    }
+    if (!btn_dma) {
+        debug.println(F("UI: no DMA sprites, drawing directly"));
+        btn_sprite[0].deleteSprite();
+        btn_sprite[1].deleteSprite();
+    }
+#endif // UI_SPRITE_DMA
+
+#ifdef BTN_CACHE
+    if (btn_dma) {
+        btn_render.setColorDepth(4);
+        btn_cache = (struct btn_cache_entry *)calloc(BTN_CACHE_ENTRIES, sizeof(struct btn_cache_entry));
+        if ((btn_cache == NULL) || (btn_render.createSprite(BTN_W, BTN_H) == NULL)) {
+            debug.println(F("UI: no memory for button cache"));
+            free(btn_cache);
+            btn_cache = NULL;
+            btn_render.deleteSprite();
+        } else {
+            btn_render.setTextColor(BTN_PAL_TEXT, BTN_PAL_TEXT_BG, true);
+            btn_render.setTextDatum(MC_DATUM); // middle center
+        }
+    }
+#endif // BTN_CACHE
+
     ledcSetup(LEDC_CHANNEL_0, LEDC_BASE_FREQ, LEDC_TIMER_12_BIT);
     ledcAttachPin(TFT_BL, LEDC_CHANNEL_0);
     curr_brightness = set_max_brightness;
@@ -435,69 +769,64 @@ void ui_init(void) {
     ldr_value = analogRead(LDR_PIN);
 
     ui_progress(UI_INIT);
-}
-
-static void ui_draw_menu(void) {
-    tft.fillScreen(TFT_BLACK);
 
-    tft.setTextDatum(TL_DATUM); // top left
-    tft.drawString(ui_page_to_str(ui_page), 0, 0, 1);
+    sched_add("ui", ui_run, UI_HANDLE_INTERVAL);
 
-    tft.setTextColor(TFT_VIOLET, TFT_BLACK, true);
-    tft.setTextDatum(TR_DATUM); // top right
-    String pos_s = String(ui_page) + " / " + String(UI_NUM_PAGES - 2);
-    tft.drawString(pos_s, TFT_HEIGHT - 1, 0, 1);
+    touch_job = sched_add("touch", touch_run, 0);
+    pinMode(XPT2046_IRQ, INPUT);
+    attachInterrupt(digitalPinToInterrupt(XPT2046_IRQ), touch_isr, FALLING);
+}
 
-    tft.setTextColor(TFT_WHITE, TFT_BLACK, true);
+static void ui_draw_page(void) {
+    if ((ui_page == UI_START) || (ui_page >= UI_NUM_PAGES)) {
+        ui_page = UI_DEFAULT_PAGE;
+    }
 
-    switch (ui_page) {
-        case UI_START:
-#if defined(SENSOR_LOCATION_BATHROOM)
-            ui_page = UI_BATHROOM1;
-#elif defined(SENSOR_LOCATION_BEDROOM)
-            ui_page = UI_BEDROOM;
-#else
-            ui_page = UI_LIVINGROOM1;
-#endif
+    if (ui_page == UI_INFO) {
+        draw_info();
+        ui_invalidate(); // info page is always drawn completely
+        return;
+    }
 
-            ui_draw_menu();
-            return;
+    // only clear the screen when switching pages, otherwise just changed buttons are drawn
+    if (ui_page != drawn_page) {
+        drawn_page = ui_page;
+        for (int i = 0; i < (BTN_COLS * BTN_ROWS); i++) {
+            widgets[i].valid = false;
+        }
 
-        case UI_LIVINGROOM1:
-            draw_livingroom1();
-            break;
+        tft.fillScreen(TFT_BLACK);
 
-        case UI_LIVINGROOM2:
-            draw_livingroom2();
-            break;
+        tft.setTextDatum(TL_DATUM); // top left
+        tft.drawString(ui_page_defs[ui_page].name, 0, 0, 1);
 
-        case UI_LIVINGROOM3:
-            draw_livingroom3();
-            break;
+        tft.setTextColor(TFT_VIOLET, TFT_BLACK, true);
+        tft.setTextDatum(TR_DATUM); // top right
+        String pos_s = String(ui_page) + " / " + String(UI_NUM_PAGES - 2);
+        tft.drawString(pos_s, TFT_HEIGHT - 1, 0, 1);
 
-        case UI_BATHROOM1:
-            draw_bathroom1();
-            break;
+        tft.setTextColor(TFT_WHITE, TFT_BLACK, true);
+    }
 
-        case UI_BATHROOM2:
-            draw_bathroom2();
-            break;
+    for (int slot = 0; slot < (BTN_COLS * BTN_ROWS); slot++) {
+        draw_slot(slot);
+    }
+}
 
-        case UI_BEDROOM:
-            draw_bedroom();
-            break;
+static void ui_draw_menu(void) {
+    ui_dma_finish();
 
-        case UI_INFO:
-            draw_info();
-            return; // no next button
+    ui_dirty = false;
+    last_redraw = millis();
+    redraws++;
 
-        default:
-            ui_page = UI_START;
-            ui_draw_menu();
-            return;
-    }
+    unsigned long start = micros();
+    ui_draw_page();
+    unsigned long frame = micros() - start;
 
-    draw_button("Next...", BTNS_OFF_X + BTN_W / 2 + BTN_W + BTN_GAP, BTNS_OFF_Y + BTN_H / 2 + (BTN_H + BTN_GAP) * 2, TFT_CYAN);
+    // buttons may still be transferred, this is the time the CPU was busy
+    frame_last[ui_page] = frame;
+    frame_max[ui_page] = MAX(frame_max[ui_page], frame);
 }
 
 static void ui_draw_reticule(int x, int y, int l) {
@@ -507,17 +836,9 @@ static void ui_draw_reticule(int x, int y, int l) {
     tft.drawPixel(x, y, TFT_WHITE);
 }
 
-static TS_Point touchToScreen(TS_Point p) {
-    p.x = map(p.x, config.touch_calibrate_left, config.touch_calibrate_right, CALIB_1_X, CALIB_2_X);
-    p.y = map(p.y, config.touch_calibrate_top, config.touch_calibrate_bottom, CALIB_1_Y, CALIB_2_Y);
-    if (p.x < 0) { p.x = 0; }
-    if (p.x >= LCD_WIDTH) { p.x = LCD_WIDTH - 1; }
-    if (p.y < 0) { p.y = 0; }
-    if (p.y >= LCD_HEIGHT) { p.y = LCD_HEIGHT - 1; }
-    return p;
-}
-
 static void ui_calibrate_touchscreen(void) {
+    ui_invalidate();
+
     for (int step = 0; step < 3; step++) {
         tft.fillScreen(TFT_BLACK);
         tft.setTextDatum(MC_DATUM); // middle center
@@ -571,6 +892,7 @@ static void ui_calibrate_touchscreen(void) {
 }
 
 void ui_progress(enum ui_state state) {
+    ui_dma_finish();
     ui_init_state = state;
 
     int x = LCD_WIDTH / 2;
@@ -579,6 +901,7 @@ void ui_progress(enum ui_state state) {
 
     switch (state) {
         case UI_INIT: {
+            ui_invalidate();
             tft.fillScreen(TFT_BLACK);
             tft.setTextDatum(MC_DATUM); // middle center
             tft.drawString("Initializing ESP-ENV", x, y - 32, fontSize);
@@ -633,14 +956,106 @@ void ui_progress(enum ui_state state) {
         } break;
 
         case UI_UPDATE: {
-            if (curr_brightness >= set_max_brightness) {
-                ui_draw_menu();
+            // drawn from ui_run(), bursts of messages only cause one redraw
+            if (ui_dirty) {
+                redraws_skipped++;
             }
+            ui_dirty = true;
         } break;
     }
 }
 
+static void ui_next_page(void) {
+    // skip init and info screen
+    do {
+        ui_page = (enum ui_pages)((ui_page + 1) % UI_NUM_PAGES);
+    } while ((ui_page == UI_START) || (ui_page == UI_INFO));
+
+    ui_draw_menu();
+}
+
+static void ui_touch_press(int x, int y) {
+    last_touch_time = millis();
+    touch_next_pending = false; // in case the release got dropped
+
+    // skip touch event and just go back to full brightness
+    touch_woke = curr_brightness < set_max_brightness;
+    if (touch_woke) {
+        ui_invalidate(); // exit standby screen
+        ui_draw_menu(); // re-draw normal screen contents
+        return; // ui_run() increases brightness
+    }
+
+    if (ui_page == UI_INFO) {
+        ui_next_page();
+        return;
+    }
+
+    int slot = ui_slot_at(x, y);
+    if (slot < 0) {
+        return;
+    }
+
+    const struct ui_button *b = &ui_page_defs[ui_page].buttons[slot];
+    switch (b->type) {
+        case UI_BTN_TOGGLE:
+            INVERT_BOOL(*ui_bool(b->field));
+            break;
+
+        case UI_BTN_BATH_LIGHT:
+            ui_status.bathroom_lights = (enum bathroom_light_states)b->value;
+            break;
+
+        case UI_BTN_ACTION:
+            b->action();
+            break;
+
+        case UI_BTN_NEXT:
+            // wait for the release, it may still become a long press
+            touch_next_pending = true;
+            return;
+
+        default:
+            return; // only shows a value
+    }
+
+    writeMQTT_UI();
+    ui_draw_menu();
+}
+
+static void ui_touch_long_press(void) {
+    last_touch_time = millis();
+
+    // holding the next button opens the info page, like the BOOT button
+    if (touch_next_pending) {
+        touch_next_pending = false;
+        ui_page = UI_INFO;
+        ui_draw_menu();
+    }
+}
+
+static void ui_touch_release(void) {
+    if (touch_next_pending) {
+        touch_next_pending = false;
+        ui_next_page();
+    }
+}
+
 void ui_run(void) {
+    // last frame was transferred while the other jobs ran
+    ui_dma_finish();
+
+    struct touch_event e;
+    while (touch_pop(&e)) {
+        if (e.type == TOUCH_PRESS) {
+            ui_touch_press(e.x, e.y);
+        } else if (e.type == TOUCH_LONG_PRESS) {
+            ui_touch_long_press();
+        } else if (e.type == TOUCH_RELEASE) {
+            ui_touch_release();
+        }
+    }
+
     unsigned long now = millis();
 
     // go to info page when BOOT button is pressed
@@ -677,149 +1092,88 @@ void ui_run(void) {
         } else {
             if ((curr_brightness > STANDBY_BRIGHTNESS) || ((now - last_standby_draw) >= STANDBY_REDRAW_MS)) {
                 // enter standby screen
+                ui_dma_finish();
+                ui_invalidate();
                 draw_standby();
                 last_standby_draw = now;
             }
             curr_brightness = STANDBY_BRIGHTNESS;
         }
         ledcAnalogWrite(LEDC_CHANNEL_0, curr_brightness);
-    }
-
-    bool touched = ts.tirqTouched() && ts.touched();
-    TS_Point p;
 
-    if (touched) {
-        p = touchToScreen(ts.getPoint());
-
-        // minimum pressure
-        if (p.z < TOUCH_PRESSURE_MIN) {
-            touched = false;
+        if (ui_dirty && ((now - last_redraw) >= UI_FRAME_INTERVAL)) {
+            if (curr_brightness >= set_max_brightness) {
+                ui_draw_menu();
+            } else {
+                // menu is re-drawn anyway when leaving standby
+                ui_dirty = false;
+            }
         }
     }
+}
 
-    if (touched && (!is_touched)) {
-        is_touched = true;
-        last_touch_time = now;
-
-        // skip touch event and just go back to full brightness
-        if (curr_brightness < set_max_brightness) {
-            tft.fillScreen(TFT_BLACK); // exit standby screen
-            ui_draw_menu(); // re-draw normal screen contents
-            return ui_run(); // skip touch and increase brightness
-        }
+void ui_update_field(size_t field) {
+    for (int slot = 0; slot < (BTN_COLS * BTN_ROWS); slot++) {
+        const struct ui_button *b = &ui_page_defs[ui_page].buttons[slot];
+        bool shown = (b->type == UI_BTN_TOGGLE) || (b->type == UI_BTN_STATUS)
+                || (b->type == UI_BTN_BATH_LIGHT) || (b->type == UI_BTN_VALUE);
 
-        if (ui_page == UI_INFO) {
-            // switch to next page, skip init and info screen
-            do {
-                ui_page = (enum ui_pages)((ui_page + 1) % UI_NUM_PAGES);
-            } while ((ui_page == UI_START) || (ui_page == UI_INFO));
-            tft.fillScreen(TFT_BLACK);
-
-            ui_draw_menu();
+        // action labels may depend on any field
+        if ((shown && (b->field == field)) || ((b->type == UI_BTN_ACTION) && (b->state != NULL))) {
+            ui_progress(UI_UPDATE);
             return;
         }
+    }
 
-        if ((p.x >= BTNS_OFF_X) && (p.x <= BTNS_OFF_X + BTN_W) && (p.y >= BTNS_OFF_Y) && (p.y <= BTNS_OFF_Y + BTN_H)) {
-            // 1
-            if (ui_page == UI_LIVINGROOM1) {
-                INVERT_BOOL(ui_status.light_corner);
-            } else if (ui_page == UI_LIVINGROOM2) {
-                INVERT_BOOL(ui_status.light_pc);
-            } else if (ui_page == UI_LIVINGROOM3) {
-                INVERT_BOOL(ui_status.pc_displays);
-            } else if (ui_page == UI_BATHROOM2) {
-                ui_status.bathroom_lights = BATH_LIGHT_NONE;
-            } else if (ui_page == UI_BEDROOM) {
-                INVERT_BOOL(ui_status.light_nightstand1);
-            }
-            writeMQTT_UI();
-        } else if ((p.x >= BTNS_OFF_X) && (p.x <= BTNS_OFF_X + BTN_W) && (p.y >= (BTNS_OFF_Y + BTN_H + BTN_GAP)) && (p.y <= (BTNS_OFF_Y + BTN_H + BTN_GAP + BTN_H))) {
-            // 2
-            if (ui_page == UI_LIVINGROOM1) {
-                INVERT_BOOL(ui_status.light_workspace);
-            } else if (ui_page == UI_LIVINGROOM2) {
-                INVERT_BOOL(ui_status.light_bench);
-            } else if (ui_page == UI_BATHROOM1) {
-                writeMQTT_bath_fan_force(120);
-            } else if (ui_page == UI_BATHROOM2) {
-                ui_status.bathroom_lights = BATH_LIGHT_BIG;
-            } else if (ui_page == UI_BEDROOM) {
-                // only show status of heated blanket
-            }
-            writeMQTT_UI();
-        } else if ((p.x >= BTNS_OFF_X) && (p.x <= BTNS_OFF_X + BTN_W) && (p.y >= (BTNS_OFF_Y + BTN_H * 2 + BTN_GAP * 2)) && (p.y <= (BTNS_OFF_Y + BTN_H * 2 + BTN_GAP * 2 + BTN_H))) {
-            // 3
-            if (ui_page == UI_LIVINGROOM1) {
-                INVERT_BOOL(ui_status.sound_amplifier);
-            } else if (ui_page == UI_LIVINGROOM2) {
-                bool on = ui_status.light_amp || ui_status.light_bench || ui_status.light_box
-                || ui_status.light_kitchen || ui_status.light_pc;
-                ui_status.light_amp = !on;
-                ui_status.light_bench = !on;
-                ui_status.light_box = !on;
-                ui_status.light_kitchen = !on;
-                ui_status.light_pc = !on;
-            } else if (ui_page == UI_BATHROOM2) {
-                ui_status.bathroom_lights = BATH_LIGHT_BOTH;
-            }
-            writeMQTT_UI();
-        } else if ((p.x >= BTNS_OFF_X + BTN_W + BTN_GAP) && (p.x <= BTNS_OFF_X + BTN_W + BTN_GAP + BTN_W) && (p.y >= BTNS_OFF_Y) && (p.y <= BTNS_OFF_Y + BTN_H)) {
-            // 4
-            if (ui_page == UI_LIVINGROOM1) {
-                INVERT_BOOL(ui_status.led_strip_pc);
-            } else if (ui_page == UI_LIVINGROOM2) {
-                INVERT_BOOL(ui_status.light_amp);
-            } else if (ui_page == UI_LIVINGROOM3) {
-                INVERT_BOOL(ui_status.light_kitchen);
-            } else if (ui_page == UI_BATHROOM2) {
-                ui_status.bathroom_lights = BATH_LIGHT_OFF;
-            }
-            writeMQTT_UI();
-        } else if ((p.x >= BTNS_OFF_X + BTN_W + BTN_GAP) && (p.x <= BTNS_OFF_X + BTN_W + BTN_GAP + BTN_W) && (p.y >= (BTNS_OFF_Y + BTN_H + BTN_GAP)) && (p.y <= (BTNS_OFF_Y + BTN_H + BTN_GAP + BTN_H))) {
-            // 5
-            if (ui_page == UI_LIVINGROOM1) {
-                bool on = ui_status.light_corner || ui_status.light_sink || ui_status.light_workspace
-                        || ui_status.light_amp || ui_status.light_bench || ui_status.light_box
-                        || ui_status.light_kitchen || ui_status.light_pc || ui_status.pc_displays
-                        || ui_status.light_nightstand1 || ui_status.led_strip_pc;
-                if (on) {
-                    ui_status.light_amp = false;
-                    ui_status.light_kitchen = false;
-                    ui_status.light_bench= false;
-                    ui_status.light_workspace = false;
-                    ui_status.light_pc = false;
-                    ui_status.light_corner = false;
-                    ui_status.light_box = false;
-                    ui_status.light_sink = false;
-                    ui_status.light_nightstand1 = false;
-                    ui_status.pc_displays = false;
-                    ui_status.led_strip_pc = false;
-                } else {
-                    ui_status.light_corner = true;
-                    ui_status.light_sink = true;
-                    ui_status.pc_displays = true;
-                    ui_status.led_strip_pc = true;
-                }
-            } else if (ui_page == UI_LIVINGROOM2) {
-                INVERT_BOOL(ui_status.light_box);
-            } else if (ui_page == UI_LIVINGROOM3) {
-                INVERT_BOOL(ui_status.light_sink);
-            } else if (ui_page == UI_BATHROOM2) {
-                ui_status.bathroom_lights = BATH_LIGHT_SMALL;
-            }
-            writeMQTT_UI();
-        } else if ((p.x >= BTNS_OFF_X + BTN_W + BTN_GAP) && (p.x <= BTNS_OFF_X + BTN_W + BTN_GAP + BTN_W) && (p.y >= (BTNS_OFF_Y + BTN_H * 2 + BTN_GAP * 2)) && (p.y <= (BTNS_OFF_Y + BTN_H * 2 + BTN_GAP * 2 + BTN_H))) {
-            // switch to next page, skip init and info screen
-            do {
-                ui_page = (enum ui_pages)((ui_page + 1) % UI_NUM_PAGES);
-            } while ((ui_page == UI_START) || (ui_page == UI_INFO));
-            tft.fillScreen(TFT_BLACK);
-        }
+    // not visible on current page
+    redraws_skipped++;
+}
 
-        ui_draw_menu();
-    } else if ((!touched) && is_touched && ((now - last_touch_time) >= MIN_TOUCH_DELAY_MS)) {
-        is_touched = false;
+String ui_stats(void) {
+    String s;
+    s += F("Redraws: ");
+    s += String(redraws);
+    s += F(", Skipped: ");
+    s += String(redraws_skipped);
+    s += F("<br>Buttons drawn: ");
+    s += String(widgets_drawn);
+    s += F(", Unchanged: ");
+    s += String(widgets_unchanged);
+#ifdef UI_SPRITE_DMA
+    s += btn_dma ? F("<br>Sprites with DMA") : F("<br>Direct drawing, DMA failed");
+#else
+    s += F("<br>Direct drawing");
+#endif // UI_SPRITE_DMA
+#ifdef BTN_CACHE
+    if (btn_cache != NULL) {
+        s += F("<br>Button cache hits / misses: ");
+        s += String(btn_cache_hits);
+        s += F(" / ");
+        s += String(btn_cache_misses);
+        s += F(" (");
+        s += String(BTN_CACHE_ENTRIES);
+        s += F(" entries)");
+    }
+#endif // BTN_CACHE
+    s += F("<br>Touch events: ");
+    s += String(touch_events);
+    s += F(", Dropped: ");
+    s += String(touch_dropped);
+    s += F(", IRQ wake-ups / ignored: ");
+    s += String(touch_wakeups);
+    s += F(" / ");
+    s += String(touch_irq_ignored);
+    s += F("<br>Frame time last / max:");
+    for (int i = UI_LIVINGROOM1; i < UI_NUM_PAGES; i++) {
+        s += F("<br>");
+        s += ui_page_defs[i].name;
+        s += F(": ");
+        s += String(frame_last[i]);
+        s += F(" / ");
+        s += String(frame_max[i]);
+        s += F("us");
     }
+    return s;
 }
 
 #endif // FEATURE_UI